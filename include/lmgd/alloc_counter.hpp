@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+namespace lmgd::alloc
+{
+
+// Counting of heap allocations is only available, if lmgd was built with COUNT_ALLOCATIONS, as it
+// replaces the global operator new.
+#ifdef LMGD_COUNT_ALLOCATIONS
+constexpr bool counting_enabled = true;
+#else
+constexpr bool counting_enabled = false;
+#endif
+
+// Returns the number of heap allocations done by the calling thread so far. Always zero, if
+// counting is disabled.
+std::uint64_t count();
+
+// Counts the heap allocations between two successive calls of tick() on the same thread.
+class Tracker
+{
+public:
+    std::uint64_t tick()
+    {
+        auto now = count();
+        auto allocations = now - last_;
+        last_ = now;
+        return allocations;
+    }
+
+private:
+    std::uint64_t last_ = count();
+};
+} // namespace lmgd::alloc
@@ -11,6 +11,7 @@
 
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <cassert>
@@ -41,8 +42,22 @@ private:
 public:
     Channel(device::Device& device, int id, const nlohmann::json& config);
 
+    // Parses a metric as given in the config, e.g., "power@narrow"
+    static std::pair<MetricType, MetricBandwidth>
+    parse_metric(const std::string& metric, MeasurementMode mode, const std::string& channel);
+
+public:
+    // Takes over changed ranges from the config of this channel and adds the commands to apply them
+    // to the device. Returns false, if nothing changed.
+    bool update_ranges(const nlohmann::json& config, network::CommandBatch& commands);
+
+    std::string current_range_command() const;
+    std::string voltage_range_command() const;
+
 public:
     const std::string& name() const;
+    // The name only matters for the metrics, not for the device
+    void name(const std::string& name);
 
     ChannelSignalCoupling coupling() const;
 
@@ -55,7 +70,6 @@ public:
     int id() const;
 
 private:
-    network::Connection& connection_;
     int id_;
     std::string name_;
     MetricSetType metrics_;
@@ -9,20 +9,42 @@
 #include <asio/io_service.hpp>
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace lmgd::device
 {
+// A running recording, passed on from one lmgd process to another
+struct Handover
+{
+    network::Connection::Released connection;
+    // What the other process learned from the device during the setup
+    nlohmann::json state;
+};
+
 class Device
 {
 public:
     Device(asio::io_service& io_service, const nlohmann::json& config);
 
+    // Only builds the setup from the config without connecting to the device, so config errors
+    // show up before touching it. Nothing talking to the device may be used.
+    explicit Device(const nlohmann::json& config);
+
+    // Takes over a running recording from another process, see hand_over(). Nothing is sent to
+    // the device, the config must result in the same setup as the one of the other process.
+    Device(asio::io_service& io_service, const nlohmann::json& config, Handover handover);
+
     ~Device();
 
 public:
     void start_recording(lmgd::network::Connection::Mode mode);
     void stop_recording();
+    // Gives up on the device without talking to it anymore, see Connection::abort
+    void abort();
+    // Gives up the device, but leaves the recording running for another process to take over.
+    // Must be called after the callback of fetch_binary_data ended the stream.
+    Handover hand_over();
     void fetch_binary_data(network::BinaryCallback);
     void fetch_data(network::Callback);
 
@@ -33,6 +55,17 @@ public:
         return mode_;
     }
 
+    // The format in which the device sends the recorded values
+    network::Connection::Mode data_format() const
+    {
+        return format_;
+    }
+
+    bool recording() const
+    {
+        return recording_;
+    }
+
     double sampling_rate() const
     {
         return sampling_rate_;
@@ -43,21 +76,78 @@ public:
         return gap_length_;
     }
 
+    // Expected time between two frames in seconds
+    double frame_interval() const
+    {
+        if (mode_ == MeasurementMode::gapless)
+        {
+            return gap_length_ / sampling_rate_;
+        }
+        return 1. / sampling_rate_;
+    }
+
+    // Expected size of one binary frame in bytes, without the chunk headers
+    std::size_t frame_size() const;
+
+    // The action executed by the device during the recording, which sends the values of all
+    // tracks. Gets the timestamps too in gapless mode.
+    std::string action_command() const;
+
+    // Checks, if the frame contains all values of the current recording. Damaged frames, e.g.,
+    // after a resynchronization of the stream, would be read beyond their end. In gapless mode,
+    // each track has to have gap_length values.
+    bool check_frame(const network::BinaryData& data) const;
+
+    const network::ResyncStats& resync_stats() const;
+
+    // Cleans up after the end of the data stream, so the device takes commands and the recording
+    // can be started again.
+    void reset_stream();
+
+    // Takes over the channel names from the config. Doesn't talk to the device, the names only
+    // matter for the metrics.
+    void rename_channels(const nlohmann::json& config);
+    // Sends the commands for changed current and voltage ranges of the channels. Must be called
+    // after the end of the data stream.
+    void update_ranges(const nlohmann::json& config);
+
+    // The commands sent to the device during the setup
+    const network::CommandBatch& setup_commands() const
+    {
+        return setup_commands_;
+    }
+
 private:
+    void read_format(const nlohmann::json& config);
+    // Creates the channels and tracks along with the commands to set them up
+    void add_setup_commands(const nlohmann::json& config);
     void add_track(const Channel& channel, MetricType type, MetricBandwidth bandwidth);
     void check_serial_number(const nlohmann::json& config);
 
+    // Sends the setup commands, unless warm attach is enabled and the device is still set up like
+    // that from our last run.
+    void configure(const nlohmann::json& config);
+    bool check_live_state(const std::vector<std::string>& unsupported);
+    std::vector<std::string> setup() const;
+    void remember_setup();
+
     friend class Channel;
 
 private:
-    asio::io_service& io_service_;
     std::string name_;
+    std::string identification_;
     std::unique_ptr<lmgd::network::Connection> connection_;
     std::vector<Channel> channels_;
     std::vector<Track> tracks_;
+    network::CommandBatch setup_commands_;
+    // Only set for warm attach
+    std::string serial_;
+    std::string state_cache_;
+    std::vector<std::string> unsupported_;
     MeasurementMode mode_;
+    network::Connection::Mode format_;
 
-    bool recording_;
+    bool recording_ = false;
 
     int64_t gap_length_;
     double sampling_rate_;
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lmgd::device
+{
+
+// Remembers for each device, keyed by its serial number, how we set it up last and what it is
+// capable of. The cache is a JSON file, so it survives restarts of lmgd.
+//
+// All devices share the file, possibly from several threads or processes. Changes are read,
+// modified and written under an flock() of a lock file next to it.
+//
+// Problems with the file are never fatal, in the worst case the device is set up from scratch.
+class StateCache
+{
+public:
+    // In the state directory of lmgd, which is created if missing. Nobody else may write there.
+    static constexpr const char* default_path = "/var/lib/lmgd/state.json";
+
+    struct Entry
+    {
+        // The answer to *idn?, which includes the firmware version
+        std::string identification;
+        // All setup commands sent to the device
+        std::vector<std::string> setup;
+        // The optional setup commands, which the device doesn't know
+        std::vector<std::string> unsupported;
+    };
+
+    explicit StateCache(std::string path);
+
+public:
+    std::optional<Entry> get(const std::string& serial) const;
+    void put(const std::string& serial, const Entry& entry);
+    void erase(const std::string& serial);
+
+private:
+    void load();
+    // Applies change to the current content of the file. Saves it, if change returns true.
+    void modify(const std::function<bool(nlohmann::json&)>& change);
+    void save() const;
+
+private:
+    std::string path_;
+    nlohmann::json data_;
+};
+} // namespace lmgd::device
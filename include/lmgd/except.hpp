@@ -2,7 +2,16 @@
 
 #include <nitro/except/raise.hpp>
 
+#include <stdexcept>
+
 namespace lmgd
 {
 using nitro::raise;
+
+// The device didn't answer or take data in time
+class TimeoutError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
 } // namespace lmgd
@@ -2,14 +2,14 @@
 
 #include <lmgd/network/callback.hpp>
 #include <lmgd/network/data.hpp>
+#include <lmgd/network/frame_parser.hpp>
+#include <lmgd/network/frame_pool.hpp>
 
 #include <lmgd/except.hpp>
 #include <lmgd/log.hpp>
 
 #include <asio/buffer.hpp>
-#include <asio/completion_condition.hpp>
-#include <asio/read.hpp>
-#include <asio/serial_port.hpp>
+#include <asio/error.hpp>
 
 #include <memory>
 #include <string>
@@ -17,35 +17,19 @@
 namespace lmgd::network
 {
 
-template <typename CB>
-struct Checker
-{
-    Checker(CB cb, size_t expected_bytes = 0) : cb(cb), bytes_expected(expected_bytes)
-    {
-    }
-
-    void operator()(asio::error_code ec, size_t bytes_transferred)
-    {
-        if (ec)
-        {
-            raise("Error while receiving binary line: ", ec.message());
-        }
-
-        assert(!bytes_expected || bytes_expected == bytes_transferred);
-        cb();
-    }
-
-private:
-    CB cb;
-    size_t bytes_expected;
-};
-
 template <typename Socket, typename CB>
 class AsyncBinaryLineReader
 {
 public:
-    AsyncBinaryLineReader(Socket& socket, CB completion_callback)
-    : socket(socket), completion_callback(completion_callback)
+    // Number of successive failed reads, after which we give up on the stream
+    static constexpr int max_failed_reads = 3;
+
+    AsyncBinaryLineReader(
+        Socket& socket,
+        FrameParser& parser,
+        CB completion_callback,
+        std::size_t frame_size = 0)
+    : socket(socket), parser(parser), completion_callback(completion_callback), pool(frame_size)
     {
     }
 
@@ -53,89 +37,78 @@ public:
     {
         Log::trace() << "AsyncBinaryLineReader::read()";
 
-        data = std::make_shared<BinaryData>();
-        read_marker();
+        data = pool.acquire();
+        parse();
     }
 
 private:
-    void read_marker()
+    // Completes as many frames as possible from the already buffered data, before issuing the
+    // next read on the socket.
+    void parse()
     {
-        Log::trace() << "AsyncBinaryLineReader::read_marker()";
-
-        asio::async_read(
-            socket,
-            asio::buffer(&marker, 1),
-            asio::transfer_exactly(1),
-            Checker([this]() { this->read_chunk(); }, 1));
-    }
-
-    void read_chunk()
-    {
-        Log::trace() << "AsyncBinaryLineReader::read_chunk()";
-
-        switch (marker)
+        while (parser.parse(*data))
         {
-        case '#':
-            read_size_size();
-            break;
-        case '\n':
-            if (completion_callback(data) == CallbackResult::repeat)
+            Log::trace() << "AsyncBinaryLineReader::parse(): completed frame of " << data->size()
+                         << " bytes";
+
+            if (completion_callback(data) != CallbackResult::repeat)
             {
-                read();
+                return;
             }
-            break;
-        default:
-            // TODO panic
-            raise("Invalid marker in binary: ", std::to_string(marker));
+
+            data = pool.acquire();
         }
+
+        read_some();
     }
 
-    void read_size_size()
+    void read_some()
     {
-        Log::trace() << "AsyncBinaryLineReader::read_size_size()";
-
-        asio::async_read(
-            socket,
-            asio::buffer(&size_size_char, 1),
-            asio::transfer_exactly(1),
-            Checker([this]() { this->read_size(); }, 1));
+        Log::trace() << "AsyncBinaryLineReader::read_some()";
+
+        socket.async_read_some(
+            parser.prepare(), [this](asio::error_code ec, size_t bytes_transferred) {
+                if (ec)
+                {
+                    this->read_failed(ec);
+                    return;
+                }
+
+                this->failed_reads = 0;
+                this->parser.commit(bytes_transferred);
+                this->parse();
+            });
     }
 
-    void read_size()
+    void read_failed(asio::error_code ec)
     {
-        auto size_size = size_size_char - '0';
+        if (ec == asio::error::operation_aborted)
+        {
+            Log::debug() << "Reading binary stream aborted";
+            return;
+        }
 
-        Log::trace() << "AsyncBinaryLineReader::read_size(): " << size_size;
+        // If the other side is gone, there is nothing left to resynchronize to.
+        if (ec == asio::error::eof || ec == asio::error::connection_reset ||
+            ++failed_reads > max_failed_reads)
+        {
+            raise("Error while receiving binary line: ", ec.message());
+        }
 
-        size_str.resize(size_size);
-        asio::async_read(
-            socket,
-            asio::buffer(size_str),
-            asio::transfer_exactly(size_size),
-            Checker([this]() { this->read_data(); }, size_size));
-    }
+        Log::warn() << "Error while receiving binary line: " << ec.message()
+                    << ". Resynchronizing...";
 
-    void read_data()
-    {
-        Log::trace() << "AsyncBinaryLineReader::read_data()";
-
-        auto data_size = std::stoll(size_str);
-        auto buf = data->append(data_size);
-        asio::async_read(
-            socket,
-            asio::buffer(buf, data_size),
-            asio::transfer_exactly(data_size),
-            Checker([this]() { this->read_marker(); }, data_size));
+        parser.resync();
+        read_some();
     }
 
 private:
     std::shared_ptr<BinaryData> data;
 
     Socket& socket;
+    FrameParser& parser;
     CB completion_callback;
-
-    char marker;
-    char size_size_char;
-    std::string size_str;
+    FramePool pool;
+    int failed_reads = 0;
 };
 } // namespace lmgd::network
@@ -7,12 +7,13 @@
 #include <lmgd/log.hpp>
 
 #include <asio/completion_condition.hpp>
+#include <asio/error.hpp>
 #include <asio/read_until.hpp>
-#include <asio/serial_port.hpp>
 #include <asio/streambuf.hpp>
 
-#include <memory>
+#include <cstring>
 #include <string>
+#include <string_view>
 
 namespace lmgd::network
 {
@@ -21,8 +22,8 @@ template <typename Socket, typename CB>
 class AsyncLineReader
 {
 public:
-    AsyncLineReader(Socket& socket, CB completion_callback)
-    : socket(socket), completion_callback(completion_callback)
+    AsyncLineReader(Socket& socket, asio::streambuf& buffer, CB completion_callback)
+    : socket(socket), buffer_(buffer), completion_callback(completion_callback)
     {
     }
 
@@ -58,6 +59,12 @@ private:
 
     void read_line_completed(const asio::error_code& ec, std::size_t bytes_transferred)
     {
+        if (ec == asio::error::operation_aborted)
+        {
+            Log::debug() << "Reading lines aborted";
+            return;
+        }
+
         if (ec)
         {
             raise("Error while reading line: ", ec.message());
@@ -65,24 +72,43 @@ private:
 
         Log::trace() << "AsyncLineReader::read_line_completed()";
 
-        data = std::make_shared<std::string>(
-            asio::buffers_begin(buffer_.data()),
-            asio::buffers_begin(buffer_.data()) + bytes_transferred - 1);
-        buffer_.consume(bytes_transferred);
+        // A single read usually receives more than one line, so hand out all complete lines
+        // before going back to the socket.
+        while (bytes_transferred > 0)
+        {
+            Log::trace() << "Read line of " << bytes_transferred << " bytes length";
 
-        Log::trace() << "Read line of " << bytes_transferred << " bytes length";
+            // The callback gets a view into the streambuf, which is only valid during the call.
+            std::string_view line(
+                static_cast<const char*>(buffer_.data().data()), bytes_transferred - 1);
 
-        if (completion_callback(data) == CallbackResult::repeat)
-        {
-            read();
+            auto result = completion_callback(line);
+            buffer_.consume(bytes_transferred);
+
+            if (result != CallbackResult::repeat)
+            {
+                return;
+            }
+
+            bytes_transferred = buffered_line_length();
         }
+
+        read();
     }
 
-private:
-    std::shared_ptr<std::string> data;
+    // Returns the length of the next line including the delimiter, if the buffer holds a complete
+    // line, zero otherwise.
+    std::size_t buffered_line_length() const
+    {
+        auto begin = static_cast<const char*>(buffer_.data().data());
+        auto end = static_cast<const char*>(std::memchr(begin, '\n', buffer_.size()));
 
+        return end ? end - begin + 1 : 0;
+    }
+
+private:
     Socket& socket;
+    asio::streambuf& buffer_;
     CB completion_callback;
-    asio::streambuf buffer_;
 };
 } // namespace lmgd::network
@@ -3,6 +3,7 @@
 #include <lmgd/network/data.hpp>
 
 #include <functional>
+#include <string_view>
 
 namespace lmgd::network
 {
@@ -13,5 +14,7 @@ enum class CallbackResult
 };
 
 using BinaryCallback = std::function<CallbackResult(std::shared_ptr<BinaryData>&)>;
-using Callback = std::function<CallbackResult(std::shared_ptr<std::string>&)>;
+// The line passed to the callback is a view into the receive buffer, which is only valid during
+// the call. It doesn't contain the trailing newline.
+using Callback = std::function<CallbackResult(std::string_view)>;
 } // namespace lmgd::network
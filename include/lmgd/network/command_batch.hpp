@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lmgd::network
+{
+
+// A list of setup commands, which are sent to the device joined by ';' in as few lines as possible.
+// Optional commands are sent on a line of their own.
+// See Connection::execute.
+//
+// Only commands that set values belong in here, no queries and no trigger actions, as the latter
+// take the rest of the line.
+class CommandBatch
+{
+public:
+    // Keeps the lines well below the input buffer of the device
+    static constexpr std::size_t default_max_line_length = 256;
+
+    struct Command
+    {
+        std::string text;
+        // Errors of optional commands are ignored, e.g., for commands only newer devices know.
+        bool optional;
+    };
+
+    // A range of commands, which are sent in one line. A line consists of either one optional
+    // command or only required commands.
+    struct Line
+    {
+        std::size_t begin;
+        std::size_t end;
+        bool optional;
+    };
+
+    explicit CommandBatch(std::size_t max_line_length = default_max_line_length)
+    : max_line_length_(max_line_length)
+    {
+    }
+
+public:
+    CommandBatch& add(std::string command);
+    CommandBatch& add_optional(std::string command);
+
+    // Replaces the command with the same header, i.e., everything up to the first space. Returns
+    // false, if there is no such command.
+    bool update(const std::string& command);
+
+    const std::vector<Command>& commands() const
+    {
+        return commands_;
+    }
+
+    bool empty() const
+    {
+        return commands_.empty();
+    }
+
+    void clear()
+    {
+        commands_.clear();
+    }
+
+    std::vector<Line> lines() const;
+
+    // The commands of the line joined by ';'
+    std::string join(const Line& line) const;
+
+private:
+    std::size_t max_line_length_;
+    std::vector<Command> commands_;
+};
+} // namespace lmgd::network
@@ -1,16 +1,46 @@
 #pragma once
 
 #include <lmgd/network/callback.hpp>
+#include <lmgd/network/command_batch.hpp>
 #include <lmgd/network/data.hpp>
+#include <lmgd/network/frame_parser.hpp>
+#include <lmgd/network/serial_settings.hpp>
+#include <lmgd/network/tcp_settings.hpp>
 
+#include <asio/error.hpp>
 #include <asio/io_service.hpp>
+#include <asio/steady_timer.hpp>
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <string>
+#include <variant>
+#include <vector>
 
 namespace lmgd::network
 {
 
-class Socket;
+class NetworkSocket;
+class SerialSocket;
+class UnixSocket;
+class UringSocket;
+
+struct ConnectionSettings
+{
+    // Only used for Type::serial
+    SerialSettings serial;
+    // Used for both the command and the interface socket of Type::socket and Type::uring_socket
+    TcpSettings tcp;
+    // The time limit of each synchronous operation, including the connect
+    std::chrono::milliseconds timeout = std::chrono::seconds(5);
+    // Try to take over the device as it is, without resetting it, and leave it configured when
+    // stopping
+    bool warm_attach = false;
+};
 
 class Connection
 {
@@ -24,20 +54,73 @@ public:
     enum class Type
     {
         serial,
-        socket
+        socket,
+        unix_socket,
+        uring_socket
+    };
+
+    Connection(asio::io_service& io_service, Type type, const std::string& hostname,
+               const ConnectionSettings& settings = {});
+
+    // A connection to a device, which is recording in binary mode, given up by one process for
+    // another to take over, see release()
+    struct Released
+    {
+        int fd = -1;
+        // Received, but not yet parsed. Starts at a frame boundary.
+        std::vector<std::byte> buffered;
     };
 
-    Connection(asio::io_service& io_service, Type type, const std::string& hostname);
+    // Takes over a released connection. Nothing is sent to the device, the binary stream goes on.
+    Connection(asio::io_service& io_service, Type type, const std::string& hostname,
+               const ConnectionSettings& settings, Released released);
 
     ~Connection();
 
 private:
+    // The transport is chosen at runtime, but every call is dispatched only once to the transport,
+    // which is fully specialized on its stream type.
+    using Socket = std::variant<
+        std::unique_ptr<NetworkSocket>,
+        std::unique_ptr<SerialSocket>,
+#ifdef LMGD_HAVE_IO_URING
+        std::unique_ptr<UringSocket>,
+#endif
+        std::unique_ptr<UnixSocket>>;
+
+    template <typename F>
+    decltype(auto) visit(F&& f);
+
+    template <typename F>
+    decltype(auto) visit(F&& f) const;
+
+    bool has_socket() const;
+
+    void open();
+
     void start();
 
+    bool attach();
+
     void stop();
 
     void reset();
 
+public:
+    // Gives up on the device, e.g., after it stopped answering. Aborts all pending asynchronous
+    // operations and nothing is sent to the device anymore, not even when destroying the
+    // connection. Destroy it only after the aborted handlers have run.
+    void abort();
+
+    // True, if the device was taken over without a reset. See ConnectionSettings::warm_attach.
+    bool attached() const;
+
+    // Gives up the connection, so another process can take over the running binary stream. Must be
+    // called after the callback of read_binary_async ended the stream. Returns a duplicate of the
+    // file descriptor, which the caller has to close. Afterwards, nothing is sent to the device
+    // anymore, just like after abort().
+    Released release();
+
 public:
     Mode mode() const;
     void mode(Mode mode);
@@ -46,21 +129,76 @@ public:
     void send_command(const std::string& cmd);
     void check_command(std::string cmd = "");
 
+    // Sends the batch in as few lines as possible, each with a single error query. If the device
+    // reports an error, the commands of that line are replayed one by one to find the culprit,
+    // which is harmless, as they only set values.
+    // Returns the optional commands, which the device didn't take.
+    std::vector<std::string> execute(const CommandBatch& batch);
+
+public:
+    using Timeout = std::chrono::steady_clock::duration;
+    static constexpr Timeout default_timeout = std::chrono::seconds(5);
+
+    using CommandHandler = std::function<void(asio::error_code)>;
+    using QueryHandler = std::function<void(asio::error_code, std::string)>;
+
+    // Asynchronous counterparts of send_command and read_ascii. They are queued and sent one after
+    // another. If the device didn't take a command or didn't answer within the timeout, the
+    // handler is called with asio::error::timed_out.
+    // A timeout cancels everything pending on the connection, so they can't be mixed with
+    // read_binary_async or read_async, both throw if the other is in use. All of them must be
+    // completed, before the connection is stopped.
+    void async_send_command(std::string cmd, CommandHandler handler,
+                            Timeout timeout = default_timeout);
+    void async_query(std::string query, QueryHandler handler, Timeout timeout = default_timeout);
+
 public:
     BinaryData read_binary(size_t reserved_size = 0);
 
-    void read_binary_async(BinaryCallback callback);
+    void read_binary_async(BinaryCallback callback, size_t frame_size = 0);
     void read_async(Callback callback);
+    // Cleans up after the callback of read_binary_async or read_async has ended the stream and
+    // switches back to ascii mode, so commands and a new recording can follow.
+    void stop_reading();
+    // read_binary_async or read_async is running
+    bool reading() const;
 
     std::vector<char> read_binary_raw();
 
     std::string read_ascii();
 
+    const ResyncStats& resync_stats() const;
+
 private:
+    void queue_command(std::string text, bool query, Timeout timeout, QueryHandler handler);
+    void next_command();
+    // Ignored, unless the command with this sequence number is still the current one
+    void complete_command(std::uint64_t sequence, asio::error_code ec, std::string result);
+
+private:
+    struct PendingCommand
+    {
+        // including the newline
+        std::string text;
+        bool query;
+        Timeout timeout;
+        QueryHandler handler;
+        // Tells the completions of this command from those of earlier ones
+        std::uint64_t sequence;
+        bool timed_out = false;
+    };
+
     asio::io_service& io_service_;
     Type type_;
     std::string hostname_;
-    std::unique_ptr<lmgd::network::Socket> socket_;
+    ConnectionSettings settings_;
+    Socket socket_;
     Mode mode_ = Mode::ascii;
+    bool attached_ = false;
+    bool aborted_ = false;
+
+    std::deque<PendingCommand> pending_commands_;
+    asio::steady_timer deadline_;
+    std::uint64_t next_sequence_ = 0;
 };
 } // namespace lmgd::network
@@ -4,14 +4,44 @@
 
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace lmgd::network
 {
 
-using Buffer = std::vector<std::byte>;
+// Allocator, which leaves new elements default-initialized instead of value-initialized, so
+// resizing a Buffer doesn't zero-fill bytes that are about to be overwritten by the socket anyway.
+template <typename T>
+class DefaultInitAllocator : public std::allocator<T>
+{
+public:
+    template <typename U>
+    struct rebind
+    {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    using std::allocator<T>::allocator;
+
+    template <typename U>
+    void construct(U* ptr) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new (static_cast<void*>(ptr)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args)
+    {
+        ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+
+using Buffer = std::vector<std::byte, DefaultInitAllocator<std::byte>>;
 
 template <typename T>
 class BinaryList
@@ -54,6 +84,26 @@ public:
         }
     }
 
+    // Drops the content, but keeps the allocated storage for the next frame.
+    // Must only be called, if no BinaryList is referencing the buffer anymore.
+    void clear()
+    {
+        assert(buffer_.use_count() == 1);
+        buffer_->clear();
+        position_ = 0;
+    }
+
+    void reserve(size_t size)
+    {
+        buffer_->reserve(size);
+    }
+
+    // Returns true, if there are no views of the buffer around anymore.
+    bool unique() const
+    {
+        return buffer_.use_count() == 1;
+    }
+
     std::byte* append(size_t size)
     {
         // Don't append once someone has read stuff... it's confusing
@@ -68,7 +118,10 @@ private:
     T read_raw()
     {
         static_assert(std::is_pod<T>::value, "This must be a POD.");
-        return *reinterpret_cast<T*>(read(sizeof(T)));
+        // The values are at any offset, so they may be misaligned
+        T value;
+        std::memcpy(&value, read(sizeof(T)), sizeof(T));
+        return value;
     }
 
 public:
@@ -117,6 +170,17 @@ public:
         return BinaryList<float>(buffer_, read(length * sizeof(float)), length);
     }
 
+    // Returns the value at the given offset without changing the read position
+    template <typename T>
+    T peek(size_t offset) const
+    {
+        static_assert(std::is_pod<T>::value, "This must be a POD.");
+        assert(offset + sizeof(T) <= buffer_->size());
+        T value;
+        std::memcpy(&value, buffer_->data() + offset, sizeof(T));
+        return value;
+    }
+
     std::vector<std::string> read_string_list()
     {
         // Can't be bothered to implement efficient stuff
@@ -140,6 +204,11 @@ public:
         return buffer_->size();
     }
 
+    const std::byte* data() const
+    {
+        return buffer_->data();
+    }
+
 private:
     std::byte* read(size_t size)
     {
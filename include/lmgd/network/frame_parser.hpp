@@ -0,0 +1,410 @@
+#pragma once
+
+#include <lmgd/network/ring_buffer.hpp>
+
+#include <lmgd/except.hpp>
+#include <lmgd/log.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace lmgd::network
+{
+
+// The counters are read by the stats of the source from another thread
+struct ResyncStats
+{
+    // number of times the parser had to search for the next frame
+    std::atomic<std::uint64_t> resyncs = 0;
+    // number of bytes dropped, including the partial frames
+    std::atomic<std::uint64_t> lost_bytes = 0;
+};
+
+// Incremental parser for the binary frames sent by the LMG, which look like this:
+//
+//     #<n><len><payload>#<n><len><payload>...\n
+//
+// where <n> is a single digit giving the number of digits of <len>.
+//
+// Incoming bytes are read in large blocks into a ring buffer and frames are parsed from whatever
+// is already buffered. Thus, a single read usually completes several chunks or even frames.
+//
+// If the stream is corrupted, the frame in progress is dropped and the parser skips forward to the
+// next frame terminator, which is followed by a valid chunk header. Parsing continues from there.
+class FrameParser
+{
+public:
+    static constexpr std::size_t default_buffer_size = 64 * 1024;
+
+    // Payloads at least this large are read directly into the frame, if the ring buffer is empty.
+    static constexpr std::size_t direct_read_threshold = 4 * 1024;
+
+    // Larger chunks are considered as corruption of the size digits.
+    static constexpr std::size_t max_chunk_size = 64 * 1024 * 1024;
+
+    explicit FrameParser(std::size_t buffer_size = default_buffer_size) : buffer_(buffer_size)
+    {
+    }
+
+public:
+    // Returns the region the next read from the socket should go to. Must be followed by a call to
+    // commit() with the number of bytes read.
+    asio::mutable_buffer prepare()
+    {
+        if (state_ == State::payload && buffer_.empty() &&
+            payload_remaining_ >= direct_read_threshold)
+        {
+            // Skip the ring buffer and read straight into the frame.
+            direct_ = true;
+            return asio::buffer(payload_, payload_remaining_);
+        }
+
+        direct_ = false;
+        return buffer_.prepare();
+    }
+
+    void commit(std::size_t bytes)
+    {
+        if (direct_)
+        {
+            payload_ += bytes;
+            payload_remaining_ -= bytes;
+            frame_bytes_ += bytes;
+            if (payload_remaining_ == 0)
+            {
+                state_ = State::marker;
+            }
+            direct_ = false;
+            return;
+        }
+
+        buffer_.commit(bytes);
+    }
+
+    // Parses the buffered bytes and appends the chunk payloads to sink, which must provide a
+    // `std::byte* append(std::size_t)` and a `void clear()` method.
+    //
+    // Returns true, once the terminating '\n' of a frame was consumed. Returns false, if more data
+    // needs to be read first. In that case, the next call must pass the same sink again.
+    template <typename Sink>
+    bool parse(Sink& sink)
+    {
+        if (drop_frame_)
+        {
+            sink.clear();
+            drop_frame_ = false;
+        }
+
+        while (true)
+        {
+            switch (state_)
+            {
+            case State::marker:
+            {
+                if (buffer_.empty())
+                {
+                    return false;
+                }
+
+                auto marker = next_char();
+
+                if (marker == '#')
+                {
+                    state_ = State::size_size;
+                }
+                else if (marker == '\n')
+                {
+                    frame_bytes_ = 0;
+                    return true;
+                }
+                else
+                {
+                    corrupted(sink, "Invalid marker in binary: ", marker);
+                }
+                break;
+            }
+
+            case State::size_size:
+            {
+                if (buffer_.empty())
+                {
+                    return false;
+                }
+
+                auto size_size_char = next_char();
+                if (size_size_char < '1' || size_size_char > '9')
+                {
+                    corrupted(sink, "Invalid size of size in binary: ", size_size_char);
+                    break;
+                }
+
+                size_size_ = size_size_char - '0';
+                size_ = 0;
+                state_ = State::size;
+                break;
+            }
+
+            case State::size:
+            {
+                while (size_size_ > 0 && !buffer_.empty())
+                {
+                    auto digit = next_char();
+                    if (digit < '0' || digit > '9')
+                    {
+                        corrupted(sink, "Invalid size digit in binary: ", digit);
+                        break;
+                    }
+
+                    size_ = size_ * 10 + (digit - '0');
+                    --size_size_;
+                }
+
+                if (state_ != State::size)
+                {
+                    break;
+                }
+
+                if (size_size_ > 0)
+                {
+                    return false;
+                }
+
+                if (size_ > max_chunk_size)
+                {
+                    corrupted(sink, "Invalid chunk size in binary: ", size_);
+                    break;
+                }
+
+                Log::trace() << "Reading binary chunk of size: " << size_;
+
+                payload_ = sink.append(size_);
+                payload_remaining_ = size_;
+                state_ = State::payload;
+                break;
+            }
+
+            case State::payload:
+            {
+                auto read = buffer_.read(payload_, payload_remaining_);
+                payload_ += read;
+                payload_remaining_ -= read;
+                frame_bytes_ += read;
+
+                if (payload_remaining_ > 0)
+                {
+                    return false;
+                }
+
+                state_ = State::marker;
+                break;
+            }
+
+            case State::resync:
+            {
+                if (!find_next_frame())
+                {
+                    return false;
+                }
+
+                Log::info() << "Resynchronized binary stream after dropping " << frame_bytes_
+                            << " bytes";
+
+                stats_.lost_bytes += frame_bytes_;
+                frame_bytes_ = 0;
+                state_ = State::marker;
+                break;
+            }
+            }
+        }
+    }
+
+    // Drops the frame in progress and searches for the start of the next frame, e.g., after a
+    // failed read on the socket.
+    void resync()
+    {
+        if (state_ == State::resync)
+        {
+            return;
+        }
+
+        ++stats_.resyncs;
+        state_ = State::resync;
+        drop_frame_ = true;
+        direct_ = false;
+    }
+
+    // Number of bytes read from the socket, but not yet parsed.
+    std::size_t buffered() const
+    {
+        return buffer_.size();
+    }
+
+    // Removes the bytes read from the socket, but not yet parsed, e.g., to pass them on together
+    // with the socket. Only possible in between two frames.
+    std::vector<std::byte> take_buffered()
+    {
+        assert(state_ == State::marker);
+
+        std::vector<std::byte> result(buffer_.size());
+        buffer_.read(result.data(), result.size());
+        return result;
+    }
+
+    // Counterpart of take_buffered(). The bytes are parsed before anything read from the socket.
+    void feed(const std::vector<std::byte>& data)
+    {
+        assert(state_ == State::marker);
+
+        // The stream may pass on more than fits, e.g., all the buffers of io_uring
+        if (buffer_.empty() && data.size() > buffer_.capacity())
+        {
+            auto capacity = buffer_.capacity();
+            while (capacity < data.size())
+            {
+                capacity *= 2;
+            }
+            buffer_ = RingBuffer(capacity);
+        }
+
+        std::size_t fed = 0;
+        while (fed < data.size())
+        {
+            auto buffer = buffer_.prepare();
+            if (buffer.size() == 0)
+            {
+                raise("Too much data for the frame parser: ", data.size(), " bytes");
+            }
+
+            auto size = std::min(buffer.size(), data.size() - fed);
+            std::memcpy(buffer.data(), data.data() + fed, size);
+            buffer_.commit(size);
+            fed += size;
+        }
+    }
+
+    const ResyncStats& stats() const
+    {
+        return stats_;
+    }
+
+private:
+    char next_char()
+    {
+        auto c = static_cast<char>(buffer_.front());
+        buffer_.consume(1);
+        ++frame_bytes_;
+        return c;
+    }
+
+    template <typename Sink, typename T>
+    void corrupted(Sink& sink, const char* message, T value)
+    {
+        Log::warn() << message << std::to_string(value) << ". Dropping frame of " << frame_bytes_
+                    << " bytes so far.";
+
+        sink.clear();
+        ++stats_.resyncs;
+        state_ = State::resync;
+    }
+
+    // Skips bytes until the buffer starts with a '\n', that is followed by a valid chunk header.
+    // Consumes the '\n' and returns true, if one was found. Returns false, if more data is needed.
+    bool find_next_frame()
+    {
+        while (!buffer_.empty())
+        {
+            if (static_cast<char>(buffer_.front()) == '\n')
+            {
+                // We need at least "\n#<n>" to decide
+                if (buffer_.size() < 3)
+                {
+                    return false;
+                }
+
+                auto size = header_size();
+                if (size > 0)
+                {
+                    if (buffer_.size() < size)
+                    {
+                        return false;
+                    }
+
+                    if (has_size_digits(size))
+                    {
+                        next_char();
+                        return true;
+                    }
+                }
+            }
+
+            next_char();
+        }
+
+        return false;
+    }
+
+    // Returns the number of bytes of "\n#<n><len>", if the buffer starts with "\n#<n>", zero
+    // otherwise.
+    std::size_t header_size() const
+    {
+        auto size_size_char = static_cast<char>(buffer_.at(2));
+        if (static_cast<char>(buffer_.at(1)) != '#' || size_size_char < '1' ||
+            size_size_char > '9')
+        {
+            return 0;
+        }
+
+        return 3 + (size_size_char - '0');
+    }
+
+    bool has_size_digits(std::size_t header_size) const
+    {
+        for (std::size_t i = 3; i < header_size; i++)
+        {
+            auto digit = static_cast<char>(buffer_.at(i));
+            if (digit < '0' || digit > '9')
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    enum class State
+    {
+        marker,
+        size_size,
+        size,
+        payload,
+        resync
+    };
+
+    RingBuffer buffer_;
+
+    State state_ = State::marker;
+    bool direct_ = false;
+    bool drop_frame_ = false;
+
+    int size_size_ = 0;
+    std::size_t size_ = 0;
+
+    std::byte* payload_ = nullptr;
+    std::size_t payload_remaining_ = 0;
+
+    // bytes consumed for the frame in progress
+    std::size_t frame_bytes_ = 0;
+
+    ResyncStats stats_;
+};
+} // namespace lmgd::network
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <lmgd/network/data.hpp>
+
+#include <lmgd/log.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace lmgd::network
+{
+
+// Recycles the BinaryData instances and their buffers of received frames.
+//
+// A frame is handed out again once neither the frame itself nor any BinaryList view of its buffer
+// is referenced anymore. Hence, in steady state, receiving a frame doesn't allocate at all.
+class FramePool
+{
+public:
+    // Upper bound of pooled frames. If the consumer holds on to more frames than that, the
+    // additional frames are allocated and freed as usual. This covers a full frame queue of the
+    // source.
+    static constexpr std::size_t max_frames = 128;
+
+    explicit FramePool(std::size_t frame_size = 0, std::size_t initial_frames = 4)
+    : frame_size_(frame_size)
+    {
+        frames_.reserve(max_frames);
+        while (frames_.size() < initial_frames)
+        {
+            frames_.emplace_back(std::make_shared<BinaryData>(frame_size_));
+        }
+    }
+
+public:
+    std::shared_ptr<BinaryData> acquire()
+    {
+        for (std::size_t i = 0; i < frames_.size(); i++)
+        {
+            auto& frame = frames_[next_];
+            next_ = (next_ + 1) % frames_.size();
+
+            if (frame.use_count() == 1 && frame->unique())
+            {
+                frame->clear();
+                return frame;
+            }
+        }
+
+        if (frames_.size() < max_frames)
+        {
+            Log::debug() << "Growing frame pool to " << frames_.size() + 1 << " frames";
+
+            frames_.emplace_back(std::make_shared<BinaryData>(frame_size_));
+            return frames_.back();
+        }
+
+        Log::warn() << "Frame pool exhausted, allocating unpooled frame";
+        return std::make_shared<BinaryData>(frame_size_);
+    }
+
+    std::size_t size() const
+    {
+        return frames_.size();
+    }
+
+private:
+    std::size_t frame_size_;
+    std::vector<std::shared_ptr<BinaryData>> frames_;
+    std::size_t next_ = 0;
+};
+} // namespace lmgd::network
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <lmgd/network/data.hpp>
+#include <lmgd/span.hpp>
+#include <lmgd/time.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace lmgd::network
+{
+
+// Storage aligned to Alignment bytes, with new elements left uninitialized like
+// DefaultInitAllocator
+template <typename T, std::size_t Alignment>
+class AlignedAllocator : public DefaultInitAllocator<T>
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* ptr, std::size_t)
+    {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept
+    {
+        return false;
+    }
+};
+
+// A binary frame in gapless mode, parsed at once:
+//
+//   <int64 cycle start> <int64 cycle duration> (<int64 n> <float>*n) per track
+//
+// The lists follow the 8 byte lengths at any offset, so reading them in place with a float* would
+// be misaligned at best. Each track is a Span aligned to alignment bytes instead, so loops over
+// them vectorize without peeling. A list, which isn't aligned in place, is copied with one memcpy
+// into an arena, which keeps its memory for the next frames.
+class GaplessFrame
+{
+public:
+    static constexpr std::size_t alignment = 64;
+
+    // Whether data holds the lists of that many tracks of gap_length values each
+    static bool check(const BinaryData& data, std::size_t tracks, std::int64_t gap_length)
+    {
+        if (gap_length < 0)
+        {
+            return false;
+        }
+
+        std::size_t offset = 2 * sizeof(std::int64_t);
+
+        for (std::size_t i = 0; i < tracks; i++)
+        {
+            if (offset + sizeof(std::int64_t) > data.size() ||
+                data.peek<std::int64_t>(offset) != gap_length)
+            {
+                return false;
+            }
+
+            offset += sizeof(std::int64_t) + gap_length * sizeof(float);
+        }
+
+        return offset <= data.size();
+    }
+
+    // data must pass check(). The spans may point into data, so it has to outlive them.
+    void parse(const BinaryData& data, std::size_t tracks)
+    {
+        cycle_start_ = time::TimePoint(time::Duration(data.peek<std::int64_t>(0)));
+        cycle_duration_ = time::Duration(data.peek<std::int64_t>(sizeof(std::int64_t)));
+
+        // Where each list is, and how much of the arena the misaligned ones need
+        lists_.resize(tracks);
+        std::size_t offset = 2 * sizeof(std::int64_t);
+        std::size_t arena_size = 0;
+        for (auto& list : lists_)
+        {
+            const auto size = static_cast<std::size_t>(data.peek<std::int64_t>(offset));
+            offset += sizeof(std::int64_t);
+
+            list.offset = offset;
+            list.size = size;
+            list.in_place = aligned(data.data() + offset);
+            if (!list.in_place)
+            {
+                arena_size += padded(size);
+            }
+
+            offset += size * sizeof(float);
+        }
+        assert(offset <= data.size());
+
+        arena_.resize(arena_size);
+
+        tracks_.resize(tracks);
+        std::size_t arena_offset = 0;
+        for (std::size_t i = 0; i < tracks; i++)
+        {
+            const auto& list = lists_[i];
+            if (list.in_place)
+            {
+                tracks_[i] = Span<const float>(
+                    reinterpret_cast<const float*>(data.data() + list.offset), list.size);
+                continue;
+            }
+
+            auto* out = arena_.data() + arena_offset;
+            std::memcpy(out, data.data() + list.offset, list.size * sizeof(float));
+            tracks_[i] = Span<const float>(out, list.size);
+            arena_offset += padded(list.size);
+        }
+    }
+
+    time::TimePoint cycle_start() const
+    {
+        return cycle_start_;
+    }
+
+    time::Duration cycle_duration() const
+    {
+        return cycle_duration_;
+    }
+
+    std::size_t tracks() const
+    {
+        return tracks_.size();
+    }
+
+    // The values of track i in the order of the device's tracks
+    Span<const float> track(std::size_t i) const
+    {
+        assert(i < tracks_.size());
+        return tracks_[i];
+    }
+
+private:
+    static bool aligned(const std::byte* ptr)
+    {
+        return reinterpret_cast<std::uintptr_t>(ptr) % alignment == 0;
+    }
+
+    // Keeps the next list in the arena aligned
+    static std::size_t padded(std::size_t size)
+    {
+        constexpr auto floats = alignment / sizeof(float);
+        return (size + floats - 1) / floats * floats;
+    }
+
+    struct List
+    {
+        std::size_t offset;
+        std::size_t size;
+        bool in_place;
+    };
+
+    time::TimePoint cycle_start_;
+    time::Duration cycle_duration_;
+    std::vector<List> lists_;
+    std::vector<Span<const float>> tracks_;
+    std::vector<float, AlignedAllocator<float, alignment>> arena_;
+};
+} // namespace lmgd::network
@@ -1,46 +1,32 @@
 #pragma once
 
-#include <lmgd/network/async_binary_line_reader.hpp>
-#include <lmgd/network/async_line_reader.hpp>
-#include <lmgd/network/socket.hpp>
+#include <lmgd/network/tcp_settings.hpp>
+#include <lmgd/network/transport.hpp>
 
 #include <asio/ip/tcp.hpp>
 
-#include <memory>
+#include <chrono>
 #include <string>
 
 namespace lmgd
 {
 namespace network
 {
-    class NetworkSocket : public Socket
+    // Connects the socket to hostname:port, giving up after the timeout, and applies the settings.
+    void connect(asio::ip::tcp::socket& socket, const std::string& hostname, int port,
+                 const TcpSettings& settings, std::chrono::milliseconds timeout);
+
+    class NetworkSocket : public Transport<asio::ip::tcp::socket>
     {
     public:
-        NetworkSocket(asio::io_service& io_service, const std::string& hostname, int port);
-        ~NetworkSocket();
-
-        asio::ip::tcp::socket& asio_socket()
-        {
-            return socket_;
-        }
+        NetworkSocket(asio::io_service& io_service, const std::string& hostname, int port,
+                      const TcpSettings& settings = {},
+                      Timeout timeout = std::chrono::seconds(5));
+        // Takes over an already connected socket, e.g., from another process
+        NetworkSocket(asio::io_service& io_service, int fd);
 
     public:
-        std::string read_line(char delim = '\n') override;
-        void read(std::byte* data, std::size_t bytes) override;
-        void write(const std::byte* data, std::size_t bytes) override;
-
-        void open(const std::string& port, int) override;
-        void close() override;
-        bool is_open() const override;
-
-        void read_binary_async(BinaryCallback callback) override;
-        void read_async(Callback callback) override;
-
-    private:
-        asio::ip::tcp::socket socket_;
-        std::unique_ptr<AsyncBinaryLineReader<asio::ip::tcp::socket, BinaryCallback>>
-            binary_line_reader_;
-        std::unique_ptr<AsyncLineReader<asio::ip::tcp::socket, Callback>> line_reader_;
+        void open(const std::string& hostname, int port, const TcpSettings& settings);
     };
 } // namespace network
 } // namespace lmgd
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <lmgd/except.hpp>
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+{
+#include <poll.h>
+}
+
+namespace lmgd::network
+{
+
+// Waits until the stream is ready for the poll events. Returns false on timeout.
+//
+// This works for all asio streams with a file descriptor. Streams, which don't signal readiness
+// through their file descriptor, provide an overload of their own.
+template <typename Stream>
+bool wait_for(Stream& stream, short events, std::chrono::milliseconds timeout)
+{
+    pollfd pfd{ stream.native_handle(), events, 0 };
+
+    int ret;
+    do
+    {
+        ret = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+    {
+        raise("Failed to poll: ", std::strerror(errno));
+    }
+
+    return ret > 0;
+}
+} // namespace lmgd::network
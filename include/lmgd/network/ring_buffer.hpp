@@ -0,0 +1,126 @@
+#pragma once
+
+#include <asio/buffer.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace lmgd::network
+{
+
+// A fixed-size byte ring buffer, which is filled by large reads from the socket and drained by the
+// frame parser.
+//
+// head_ and tail_ are monotonic counters, the actual position within the storage is obtained by
+// masking, hence the capacity must be a power of two.
+class RingBuffer
+{
+public:
+    explicit RingBuffer(std::size_t capacity)
+    : storage_(std::make_unique<std::byte[]>(capacity)), capacity_(capacity)
+    {
+        assert(capacity_ > 0 && (capacity_ & (capacity_ - 1)) == 0);
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&&) = default;
+    RingBuffer& operator=(RingBuffer&&) = default;
+
+public:
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    std::size_t size() const
+    {
+        return tail_ - head_;
+    }
+
+    bool empty() const
+    {
+        return head_ == tail_;
+    }
+
+    bool full() const
+    {
+        return size() == capacity_;
+    }
+
+public:
+    // Returns the largest contiguous free region after the tail. Pass it to a read operation and
+    // call commit() with the number of bytes actually received.
+    asio::mutable_buffer prepare()
+    {
+        if (empty())
+        {
+            // Rewind, so the next read can use the whole buffer in one go
+            head_ = tail_ = 0;
+        }
+
+        auto offset = tail_ & mask();
+        auto free = capacity_ - size();
+        return asio::buffer(storage_.get() + offset, std::min(free, capacity_ - offset));
+    }
+
+    void commit(std::size_t bytes)
+    {
+        assert(size() + bytes <= capacity_);
+        tail_ += bytes;
+    }
+
+    std::byte front() const
+    {
+        assert(!empty());
+        return storage_[head_ & mask()];
+    }
+
+    std::byte at(std::size_t offset) const
+    {
+        assert(offset < size());
+        return storage_[(head_ + offset) & mask()];
+    }
+
+    void consume(std::size_t bytes)
+    {
+        assert(bytes <= size());
+        head_ += bytes;
+    }
+
+    // Copies up to `bytes` bytes out of the buffer and consumes them. Returns the number of bytes
+    // copied, which is less than requested if the buffer doesn't hold enough data.
+    std::size_t read(std::byte* dest, std::size_t bytes)
+    {
+        bytes = std::min(bytes, size());
+
+        auto offset = head_ & mask();
+        auto first = std::min(bytes, capacity_ - offset);
+
+        std::memcpy(dest, storage_.get() + offset, first);
+        std::memcpy(dest + first, storage_.get(), bytes - first);
+
+        head_ += bytes;
+        return bytes;
+    }
+
+    void clear()
+    {
+        head_ = tail_ = 0;
+    }
+
+private:
+    std::size_t mask() const
+    {
+        return capacity_ - 1;
+    }
+
+    std::unique_ptr<std::byte[]> storage_;
+    std::size_t capacity_;
+    std::size_t head_ = 0;
+    std::size_t tail_ = 0;
+};
+} // namespace lmgd::network
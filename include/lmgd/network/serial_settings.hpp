@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace lmgd::network
+{
+
+struct SerialSettings
+{
+    enum class FlowControl
+    {
+        none,
+        software,
+        hardware
+    };
+
+    unsigned baud_rate = 57600;
+
+    // termios VMIN and VTIME (in 1/10 s), which only apply to blocking reads
+    unsigned char min_bytes = 1;
+    unsigned char timeout = 0;
+
+    FlowControl flow_control = FlowControl::none;
+
+    // Linux ASYNC_LOW_LATENCY, so received bytes are handed over without the usual batching.
+    // Ignored, if the driver doesn't support it, e.g., for pseudo-terminals.
+    bool low_latency = true;
+
+    // If not empty, the fastest of these baud rates, which passes a verification, is negotiated
+    // with the device at startup.
+    std::vector<unsigned> negotiate_baud_rates;
+    // The command to change the baud rate of the device, the rate is appended
+    std::string baud_rate_command = ":SYST:COMM:SER:BAUD";
+};
+} // namespace lmgd::network
@@ -1,49 +1,53 @@
 #pragma once
 
-#include <lmgd/network/async_binary_line_reader.hpp>
-#include <lmgd/network/async_line_reader.hpp>
-#include <lmgd/network/socket.hpp>
+#include <lmgd/network/serial_settings.hpp>
+#include <lmgd/network/transport.hpp>
 
 #include <asio/serial_port.hpp>
 
-#include <memory>
+#include <chrono>
 #include <string>
 
 namespace lmgd
 {
 namespace network
 {
-    class SerialSocket : public Socket
+    // Also works for pseudo-terminals, e.g., for stand-ins of the device
+    class SerialSocket : public Transport<asio::serial_port>
     {
     public:
-        SerialSocket(asio::io_service& io_service, const std::string& port);
-        ~SerialSocket();
-
-        asio::serial_port& asio_socket()
-        {
-            return socket_;
-        }
+        SerialSocket(asio::io_service& io_service, const std::string& port,
+                     const SerialSettings& settings = {});
+        // Takes over an already configured port, e.g., from another process. The settings are
+        // only used later on, the port keeps running as it is.
+        SerialSocket(asio::io_service& io_service, int fd, const SerialSettings& settings);
 
         void flush();
 
     public:
-        std::string read_line(char delim = '\n') override;
-        void read(std::byte* data, std::size_t bytes) override;
-        void write(const std::byte* data, std::size_t bytes) override;
+        void open(const std::string& port);
+
+        // Switches the device and the host to the fastest of the negotiate_baud_rates, which
+        // passes a verification. The device may still run at a rate negotiated earlier.
+        void negotiate();
 
-        void open(const std::string& host, int port) override;
-        void close() override;
-        bool is_open() const override;
+        unsigned baud_rate() const
+        {
+            return baud_rate_;
+        }
 
-        void read_binary_async(BinaryCallback callback) override;
-        void read_async(Callback callback) override;
+    private:
+        void configure();
+        void set_baud_rate(unsigned baud_rate);
+        void send(const std::string& command);
+        // Checks, if the device answers *idn? at the current baud rate
+        bool verify();
 
     private:
-        asio::serial_port socket_;
-        asio::serial_port_base::baud_rate baud_;
-        std::unique_ptr<AsyncBinaryLineReader<asio::serial_port, BinaryCallback>>
-            binary_line_reader_;
-        std::unique_ptr<AsyncLineReader<asio::serial_port, Callback>> line_reader_;
+        static constexpr std::chrono::milliseconds verify_timeout{ 500 };
+
+        SerialSettings settings_;
+        unsigned baud_rate_;
     };
 
 } // namespace network
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace lmgd::network
+{
+
+struct TcpSettings
+{
+    // Disables Nagle, so short commands aren't held back until the previous answer arrived
+    bool no_delay = true;
+
+    // SO_RCVBUF in bytes, 0 keeps the kernel default
+    int receive_buffer = 0;
+
+    // SO_BUSY_POLL in microseconds, 0 disables it. Needs CAP_NET_ADMIN for larger values than
+    // net.core.busy_read, so failing to set it is only a warning.
+    int busy_poll = 0;
+};
+} // namespace lmgd::network
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <lmgd/network/async_binary_line_reader.hpp>
+#include <lmgd/network/async_line_reader.hpp>
+#include <lmgd/network/callback.hpp>
+#include <lmgd/network/frame_parser.hpp>
+#include <lmgd/network/poll.hpp>
+
+#include <lmgd/except.hpp>
+#include <lmgd/log.hpp>
+
+#include <asio/buffers_iterator.hpp>
+#include <asio/io_service.hpp>
+#include <asio/read_until.hpp>
+#include <asio/streambuf.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+
+namespace lmgd::network
+{
+
+// Everything the stream itself has received, but not yet returned by a read. The asio streams
+// don't buffer anything, streams with a buffer of their own provide an overload.
+template <typename Stream>
+std::vector<std::byte> take_received(Stream&)
+{
+    return {};
+}
+
+// The transport to the device over any asio stream, e.g., TCP or Unix domain sockets, serial ports
+// or pseudo-terminals.
+//
+// Everything on the read path is instantiated for the concrete stream type, so there are no
+// virtual calls involved. Opening the stream is up to the derived classes.
+template <typename Stream>
+class Transport
+{
+public:
+    using stream_type = Stream;
+
+    Transport(asio::io_service& io_service) : io_service_(io_service), stream_(io_service)
+    {
+    }
+
+    Transport(const Transport&) = delete;
+    Transport& operator=(const Transport&) = delete;
+
+    ~Transport()
+    {
+        try
+        {
+            if (stream_.is_open())
+            {
+                close();
+            }
+        }
+        catch (std::exception& e)
+        {
+            Log::error() << "Catched exception while closing socket: " << e.what();
+        }
+    }
+
+public:
+    Stream& asio_socket()
+    {
+        return stream_;
+    }
+
+    asio::streambuf& asio_buffer()
+    {
+        return recv_buffer_;
+    }
+
+    FrameParser& frame_parser()
+    {
+        return frame_parser_;
+    }
+
+    const FrameParser& frame_parser() const
+    {
+        return frame_parser_;
+    }
+
+public:
+    template <typename T>
+    void write(const T& data)
+    {
+        write(reinterpret_cast<const std::byte*>(&data), sizeof(T));
+    }
+
+    template <typename T>
+    void read(T& data)
+    {
+        read(reinterpret_cast<std::byte*>(&data), sizeof(T));
+    }
+
+    template <typename T>
+    void read(std::vector<T>& data, std::size_t num_elements)
+    {
+        data.resize(num_elements);
+
+        read(reinterpret_cast<std::byte*>(data.data()), num_elements * sizeof(T));
+    }
+
+    void read(std::string& data, std::size_t num_elements)
+    {
+        std::vector<char> tmp(num_elements);
+
+        read(tmp, num_elements);
+
+        // if string is nullterminated, then cut off last char, as it's handled by std::string
+        if (tmp.back() == '\0')
+            tmp.resize(num_elements - 1);
+
+        data = std::string(tmp.begin(), tmp.end());
+    }
+
+public:
+    using Timeout = std::chrono::milliseconds;
+
+    // The time limit of each synchronous operation
+    void timeout(Timeout timeout)
+    {
+        timeout_ = timeout;
+    }
+
+    Timeout timeout() const
+    {
+        return timeout_;
+    }
+
+public:
+    std::string read_line(char delim = '\n')
+    {
+        Log::trace() << "Reading one line from buffer...";
+
+        auto deadline = Clock::now() + timeout_;
+        std::size_t searched = 0;
+        std::size_t bytes_transferred;
+
+        while (true)
+        {
+            auto begin = asio::buffers_begin(recv_buffer_.data());
+            auto end = asio::buffers_end(recv_buffer_.data());
+            auto it = std::find(begin + searched, end, delim);
+
+            if (it != end)
+            {
+                bytes_transferred = it - begin + 1;
+                break;
+            }
+            searched = recv_buffer_.size();
+
+            wait(POLLIN, deadline);
+            recv_buffer_.commit(stream_.read_some(recv_buffer_.prepare(read_size)));
+        }
+
+        std::string line(
+            asio::buffers_begin(recv_buffer_.data()),
+            asio::buffers_begin(recv_buffer_.data()) + bytes_transferred - 1);
+
+        Log::trace() << "Read line of " << bytes_transferred << " bytes length";
+
+        recv_buffer_.consume(bytes_transferred);
+        return line;
+    }
+
+    void read(std::byte* data, std::size_t bytes)
+    {
+        Log::trace() << "Reading " << bytes << " bytes from socket...";
+
+        auto deadline = Clock::now() + timeout_;
+        std::size_t reply_length = 0;
+
+        while (reply_length < bytes)
+        {
+            wait(POLLIN, deadline);
+            reply_length += stream_.read_some(
+                asio::buffer(reinterpret_cast<char*>(data) + reply_length, bytes - reply_length));
+        }
+
+        Log::trace() << "Received " << reply_length << " bytes from socket.";
+    }
+
+    // Reads at least one, but at most `bytes` bytes. Returns the number of bytes read.
+    std::size_t read_some(std::byte* data, std::size_t bytes)
+    {
+        wait(POLLIN, Clock::now() + timeout_);
+
+        std::size_t reply_length =
+            stream_.read_some(asio::buffer(reinterpret_cast<char*>(data), bytes));
+
+        Log::trace() << "Received " << reply_length << " bytes from socket.";
+
+        return reply_length;
+    }
+
+    void write(const std::byte* data, std::size_t bytes)
+    {
+        Log::trace() << "Writing " << bytes << " bytes onto socket...";
+
+        auto deadline = Clock::now() + timeout_;
+        std::size_t send_bytes = 0;
+
+        while (send_bytes < bytes)
+        {
+            wait(POLLOUT, deadline);
+            send_bytes += stream_.write_some(
+                asio::buffer(reinterpret_cast<const char*>(data) + send_bytes, bytes - send_bytes));
+        }
+
+        Log::trace() << "Wrote " << send_bytes << " bytes onto socket.";
+    }
+
+    // The buffer must stay valid until the handler was called
+    template <typename Handler>
+    void async_write(asio::const_buffer buffer, Handler&& handler)
+    {
+        asio::async_write(stream_, buffer, std::forward<Handler>(handler));
+    }
+
+    // Calls handler(error_code, std::string) with the next line without the delimiter
+    template <typename Handler>
+    void async_read_line(Handler&& handler, char delim = '\n')
+    {
+        asio::async_read_until(
+            stream_,
+            recv_buffer_,
+            delim,
+            [this, handler = std::forward<Handler>(handler)](auto ec, std::size_t bytes) mutable {
+                if (ec)
+                {
+                    handler(ec, std::string());
+                    return;
+                }
+
+                std::string line(asio::buffers_begin(recv_buffer_.data()),
+                                 asio::buffers_begin(recv_buffer_.data()) + bytes - 1);
+                recv_buffer_.consume(bytes);
+
+                handler(ec, std::move(line));
+            });
+    }
+
+    // Aborts all pending asynchronous operations
+    void cancel()
+    {
+        stream_.cancel();
+    }
+
+    // After calling this function calls to read or write are not allowed anymore
+    void close()
+    {
+        stream_.close();
+        recv_buffer_.consume(recv_buffer_.size());
+    }
+
+    bool is_open() const
+    {
+        return stream_.is_open();
+    }
+
+    // frame_size is the expected size of one frame, used to presize the frame buffers
+    void read_binary_async(BinaryCallback callback, std::size_t frame_size = 0)
+    {
+        assert(!binary_line_reader_);
+        assert(!line_reader_);
+        assert(asio_buffer().size() == 0);
+
+        binary_line_reader_ = std::make_unique<AsyncBinaryLineReader<Stream, BinaryCallback>>(
+            stream_, frame_parser_, callback, frame_size);
+        binary_line_reader_->read();
+    }
+
+    void read_async(Callback callback)
+    {
+        assert(!binary_line_reader_);
+        assert(!line_reader_);
+        assert(asio_buffer().size() == 0);
+
+        line_reader_ =
+            std::make_unique<AsyncLineReader<Stream, Callback>>(stream_, recv_buffer_, callback);
+        line_reader_->read();
+    }
+
+    bool reading() const
+    {
+        return binary_line_reader_ || line_reader_;
+    }
+
+    // Releases the reader of a finished stream, so a new one can be started. There must be no
+    // pending read, i.e., the callback has returned CallbackResult::cancel before.
+    void stop_reading()
+    {
+        binary_line_reader_.reset();
+        line_reader_.reset();
+    }
+
+    // Removes everything received, but not yet parsed, e.g., to pass it on together with the
+    // socket. Only possible in between two frames, after stop_reading().
+    std::vector<std::byte> take_buffered()
+    {
+        auto buffered = frame_parser_.take_buffered();
+        auto received = take_received(stream_);
+        buffered.insert(buffered.end(), received.begin(), received.end());
+        return buffered;
+    }
+
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t read_size = 4096;
+
+    // Throws TimeoutError, if the stream doesn't get ready before the deadline
+    void wait(short events, Clock::time_point deadline)
+    {
+        auto remaining = std::chrono::duration_cast<Timeout>(deadline - Clock::now());
+
+        if (remaining.count() <= 0 || !wait_for(stream_, events, remaining))
+        {
+            throw TimeoutError("Device didn't respond within " + std::to_string(timeout_.count()) +
+                               " ms");
+        }
+    }
+
+protected:
+    asio::io_service& io_service_;
+    Stream stream_;
+    asio::streambuf recv_buffer_;
+    FrameParser frame_parser_;
+    Timeout timeout_ = std::chrono::seconds(5);
+
+private:
+    std::unique_ptr<AsyncBinaryLineReader<Stream, BinaryCallback>> binary_line_reader_;
+    std::unique_ptr<AsyncLineReader<Stream, Callback>> line_reader_;
+};
+
+template <typename Stream, typename T>
+Transport<Stream>& operator>>(Transport<Stream>& s, T& t)
+{
+    s.read(t);
+
+    return s;
+}
+
+template <typename Stream, typename T>
+inline Transport<Stream>& operator<<(Transport<Stream>& s, const T& t)
+{
+    s.write(t);
+
+    return s;
+}
+
+template <typename Stream, typename T>
+inline Transport<Stream>& operator<<(Transport<Stream>& s, const std::vector<T>& v)
+{
+    s.write(reinterpret_cast<const std::byte*>(v.data()), v.size() * sizeof(T));
+
+    return s;
+}
+
+template <typename Stream>
+inline Transport<Stream>& operator<<(Transport<Stream>& s, const std::string& v)
+{
+    s.write(reinterpret_cast<const std::byte*>(v.data()), v.size() + 1);
+
+    return s;
+}
+} // namespace lmgd::network
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <lmgd/network/transport.hpp>
+
+#include <asio/local/stream_protocol.hpp>
+
+#include <string>
+
+namespace lmgd
+{
+namespace network
+{
+    // Unix domain socket, e.g., for local stand-ins of the device
+    class UnixSocket : public Transport<asio::local::stream_protocol::socket>
+    {
+    public:
+        UnixSocket(asio::io_service& io_service, const std::string& path);
+        // Takes over an already connected socket, e.g., from another process
+        UnixSocket(asio::io_service& io_service, int fd);
+
+    public:
+        void open(const std::string& path);
+    };
+} // namespace network
+} // namespace lmgd
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <lmgd/network/tcp_settings.hpp>
+#include <lmgd/network/transport.hpp>
+#include <lmgd/network/uring_stream.hpp>
+
+#include <string>
+
+namespace lmgd::network
+{
+
+// A TCP connection to the device, which receives through io_uring
+class UringSocket : public Transport<UringStream>
+{
+public:
+    UringSocket(asio::io_service& io_service, const std::string& hostname, int port,
+                const TcpSettings& settings = {}, Timeout timeout = std::chrono::seconds(5));
+    // Takes over an already connected socket, e.g., from another process
+    UringSocket(asio::io_service& io_service, int fd);
+
+public:
+    void open(const std::string& hostname, int port, const TcpSettings& settings);
+};
+} // namespace lmgd::network
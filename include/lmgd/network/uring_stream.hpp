@@ -0,0 +1,219 @@
+#pragma once
+
+#include <lmgd/except.hpp>
+
+#include <asio/buffer.hpp>
+#include <asio/error.hpp>
+#include <asio/io_service.hpp>
+#include <asio/posix/stream_descriptor.hpp>
+#include <asio/post.hpp>
+
+#include <liburing.h>
+
+extern "C"
+{
+#include <poll.h>
+}
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace lmgd::network
+{
+
+// A stream on a connected socket, which receives with io_uring instead of the reactor of asio.
+//
+// A multishot receive is armed once and keeps filling buffers from a ring of buffers registered
+// with the kernel, so a stream of small reads doesn't cost a syscall each. Completions are
+// signalled to the io_service through an eventfd.
+//
+// The stream implements the parts of the asio SyncReadStream, SyncWriteStream and AsyncReadStream
+// requirements used by Transport.
+class UringStream
+{
+public:
+    using executor_type = asio::io_service::executor_type;
+
+    static constexpr unsigned num_buffers = 64;
+    static constexpr std::size_t buffer_size = 16 * 1024;
+
+    explicit UringStream(asio::io_service& io_service);
+    ~UringStream();
+
+    UringStream(const UringStream&) = delete;
+    UringStream& operator=(const UringStream&) = delete;
+
+public:
+    executor_type get_executor()
+    {
+        return io_service_.get_executor();
+    }
+
+    // Takes ownership of a connected socket
+    void assign(int fd);
+
+    int native_handle() const
+    {
+        return fd_;
+    }
+
+    bool is_open() const
+    {
+        return fd_ >= 0;
+    }
+
+    void close();
+
+    // Waits until received data or an error is available. Returns false on timeout.
+    bool wait_readable(std::chrono::milliseconds timeout);
+
+    // Aborts a pending read
+    void cancel()
+    {
+        event_.cancel();
+    }
+
+    // Stops receiving and returns everything received, but not yet read, e.g., to pass it on
+    // together with the socket. Nothing is read from the socket afterwards.
+    std::vector<std::byte> take_received();
+
+public:
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers)
+    {
+        asio::error_code ec;
+        auto bytes = read_some(buffers, ec);
+        if (ec)
+        {
+            throw asio::system_error(ec);
+        }
+        return bytes;
+    }
+
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers, asio::error_code& ec)
+    {
+        return receive(*asio::buffer_sequence_begin(buffers), ec);
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers)
+    {
+        asio::error_code ec;
+        auto bytes = write_some(buffers, ec);
+        if (ec)
+        {
+            throw asio::system_error(ec);
+        }
+        return bytes;
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers, asio::error_code& ec)
+    {
+        return send(*asio::buffer_sequence_begin(buffers), ec);
+    }
+
+    template <typename MutableBufferSequence, typename Handler>
+    void async_read_some(const MutableBufferSequence& buffers, Handler&& handler)
+    {
+        async_receive(*asio::buffer_sequence_begin(buffers), std::forward<Handler>(handler));
+    }
+
+    // Writes are only small commands, so they are sent synchronously and completed through the
+    // io_service.
+    template <typename ConstBufferSequence, typename Handler>
+    void async_write_some(const ConstBufferSequence& buffers, Handler&& handler)
+    {
+        asio::error_code ec;
+        auto bytes = write_some(buffers, ec);
+        asio::post(io_service_,
+                   [handler = std::forward<Handler>(handler), ec, bytes]() mutable {
+                       handler(ec, bytes);
+                   });
+    }
+
+private:
+    using ReadHandler = std::function<void(asio::error_code, std::size_t)>;
+
+    std::size_t receive(asio::mutable_buffer buffer, asio::error_code& ec);
+    std::size_t send(asio::const_buffer buffer, asio::error_code& ec);
+    void async_receive(asio::mutable_buffer buffer, ReadHandler handler);
+
+    // nullptr, if the submission queue is still full after submitting it
+    io_uring_sqe* next_sqe();
+    void arm();
+    void wait();
+    void reap();
+    void handle(const io_uring_cqe& cqe);
+    void provide(unsigned short buffer_id);
+    std::size_t copy(asio::mutable_buffer buffer);
+
+private:
+    struct Received
+    {
+        unsigned short buffer_id;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    asio::io_service& io_service_;
+    int fd_ = -1;
+
+    io_uring ring_;
+    io_uring_buf_ring* buf_ring_ = nullptr;
+    std::unique_ptr<std::byte[]> storage_;
+    bool armed_ = false;
+    // The data is passed on, so the receive must not be armed again
+    bool released_ = false;
+
+    // Filled buffers in the order of reception, not yet copied to the reader
+    std::array<Received, num_buffers> received_;
+    std::size_t received_head_ = 0;
+    std::size_t received_count_ = 0;
+    asio::error_code error_;
+
+    asio::posix::stream_descriptor event_;
+    std::uint64_t event_count_ = 0;
+    bool waiting_ = false;
+
+    asio::mutable_buffer pending_buffer_;
+    ReadHandler pending_handler_;
+};
+
+inline std::vector<std::byte> take_received(UringStream& stream)
+{
+    return stream.take_received();
+}
+
+// The socket itself never gets readable, as the received data goes straight into the buffers.
+inline bool wait_for(UringStream& stream, short events, std::chrono::milliseconds timeout)
+{
+    if (events & POLLOUT)
+    {
+        pollfd pfd{ stream.native_handle(), POLLOUT, 0 };
+
+        int result;
+        do
+        {
+            result = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+        } while (result < 0 && errno == EINTR);
+
+        if (result < 0)
+        {
+            raise("Failed to poll: ", std::strerror(errno));
+        }
+
+        return result > 0;
+    }
+    return stream.wait_readable(timeout);
+}
+} // namespace lmgd::network
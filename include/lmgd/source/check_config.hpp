@@ -0,0 +1,37 @@
+#pragma once
+
+#include <lmgd/device/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace lmgd::source
+{
+// Checks a config as sent by MetricQ without touching the device, so invalid configs are rejected
+// before the device is reset. Throws on errors. The returned device only models the setup, see
+// device::Device(const nlohmann::json&).
+std::unique_ptr<device::Device> check_config(const nlohmann::json& config);
+
+// The config of each device. A config either describes a single device, or has a list of them in
+// "devices", each like a single one:
+//
+//   { "flush": { ... }, "devices": [ { "measurement": { ... }, "channels": [ ... ] }, ... ] }
+//
+// The other settings at the top, e.g., "flush", are the defaults of all devices.
+std::vector<nlohmann::json> device_configs(const nlohmann::json& config);
+
+// Identifies a device across configs: its serial, or the address, if there is no serial.
+std::string device_key(const nlohmann::json& device_config);
+
+// check_config() for each device. Additionally, the devices must not share keys, metrics, stats
+// or handover sockets.
+std::vector<std::unique_ptr<device::Device>> check_configs(const nlohmann::json& config);
+
+// Describes, what lmgd would do with the config: the tracks, the commands sent to the device and
+// the layout of the data frames.
+void describe(const device::Device& device, std::ostream& out);
+} // namespace lmgd::source
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <lmgd/device/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <variant>
+#include <vector>
+
+// Decides, which samples of a metric are published. Configured per channel, see track_settings.hpp,
+// e.g.,
+//
+//   "compression": {
+//       "default": { "policy": "dedup", "heartbeat": 10 },
+//       "power@narrow": { "policy": "swinging_door", "max_error": 0.5 }
+//   }
+//
+// Without any config, narrow metrics use dedup and all others none.
+//
+// Each policy calls emit(time, value) for the samples to publish, in the order of time, and emits
+// what it still holds back in finish(), when the stream ends. The heartbeat (in seconds) bounds
+// the time between two published samples, as long as samples come in. It defaults to 9 sample
+// periods, so at most 8 samples in a row are left out, as lmgd always did.
+namespace lmgd::source::compression
+{
+// Publishes everything
+struct None
+{
+    static constexpr const char* name = "none";
+
+    template <typename Emit>
+    void add(std::int64_t time, float value, Emit&& emit)
+    {
+        emit(time, value);
+    }
+
+    template <typename Emit>
+    void finish(Emit&&)
+    {
+    }
+
+    nlohmann::json state() const
+    {
+        return nlohmann::json::object();
+    }
+
+    void restore(const nlohmann::json&)
+    {
+    }
+};
+
+// Leaves out values equal to the last published one
+struct Dedup
+{
+    static constexpr const char* name = "dedup";
+
+    std::int64_t heartbeat;
+
+    // NaN never equals the first value
+    float last_value = std::numeric_limits<float>::quiet_NaN();
+    std::int64_t last_time = 0;
+
+    template <typename Emit>
+    void add(std::int64_t time, float value, Emit&& emit)
+    {
+        if (value == last_value && time - last_time < heartbeat)
+        {
+            return;
+        }
+
+        last_value = value;
+        last_time = time;
+        emit(time, value);
+    }
+
+    template <typename Emit>
+    void finish(Emit&&)
+    {
+    }
+
+    nlohmann::json state() const;
+    void restore(const nlohmann::json& state);
+};
+
+// Leaves out values, which differ from the last published one by at most
+// max(absolute, relative * |last value|)
+struct Deadband
+{
+    static constexpr const char* name = "deadband";
+
+    std::int64_t heartbeat;
+    float absolute;
+    float relative;
+
+    float last_value = std::numeric_limits<float>::quiet_NaN();
+    std::int64_t last_time = 0;
+
+    template <typename Emit>
+    void add(std::int64_t time, float value, Emit&& emit)
+    {
+        // false for NaN, so they are always published
+        if (std::abs(value - last_value) <= std::max(absolute, relative * std::abs(last_value)) &&
+            time - last_time < heartbeat)
+        {
+            return;
+        }
+
+        last_value = value;
+        last_time = time;
+        emit(time, value);
+    }
+
+    template <typename Emit>
+    void finish(Emit&&)
+    {
+    }
+
+    nlohmann::json state() const;
+    void restore(const nlohmann::json& state);
+};
+
+// Swinging door trending: publishes a sample only, if a straight line from the last published
+// one can't get within max_error of all samples since. The samples are thus delayed until the
+// door closes, but linear interpolation between the published samples is off by max_error at
+// most.
+struct SwingingDoor
+{
+    static constexpr const char* name = "swinging_door";
+
+    std::int64_t heartbeat;
+    double max_error;
+
+    // the last published sample
+    bool has_pivot = false;
+    std::int64_t pivot_time = 0;
+    double pivot_value = 0;
+    // the last sample, which isn't published yet
+    bool has_last = false;
+    std::int64_t last_time = 0;
+    double last_value = 0;
+    // slopes of the door from the pivot, in value per ns
+    double upper = 0;
+    double lower = 0;
+
+    template <typename Emit>
+    void add(std::int64_t time, float value, Emit&& emit)
+    {
+        if (has_last)
+        {
+            auto dt = static_cast<double>(time - pivot_time);
+            auto new_upper = std::min(upper, (value + max_error - pivot_value) / dt);
+            auto new_lower = std::max(lower, (value - max_error - pivot_value) / dt);
+
+            if (std::isnan(value) || new_lower > new_upper || time - pivot_time >= heartbeat)
+            {
+                // Everything up to the last sample is within the door, so it goes out
+                emit(last_time, static_cast<float>(last_value));
+                pivot(last_time, last_value);
+            }
+            else
+            {
+                upper = new_upper;
+                lower = new_lower;
+                last_time = time;
+                last_value = value;
+                return;
+            }
+        }
+        else if (!has_pivot || std::isnan(pivot_value))
+        {
+            emit(time, value);
+            pivot(time, value);
+            return;
+        }
+
+        // Opens the door from the pivot to this sample
+        auto dt = static_cast<double>(time - pivot_time);
+        upper = (value + max_error - pivot_value) / dt;
+        lower = (value - max_error - pivot_value) / dt;
+        has_last = true;
+        last_time = time;
+        last_value = value;
+
+        // NaN can't be within any door, so it goes out right away and starts anew
+        if (std::isnan(value))
+        {
+            emit(time, value);
+            pivot(time, value);
+        }
+    }
+
+    template <typename Emit>
+    void finish(Emit&& emit)
+    {
+        if (has_last)
+        {
+            emit(last_time, static_cast<float>(last_value));
+            pivot(last_time, last_value);
+        }
+    }
+
+    nlohmann::json state() const;
+    void restore(const nlohmann::json& state);
+
+private:
+    void pivot(std::int64_t time, double value)
+    {
+        has_pivot = true;
+        pivot_time = time;
+        pivot_value = value;
+        has_last = false;
+    }
+};
+
+using Policy = std::variant<None, Dedup, Deadband, SwingingDoor>;
+
+const char* name(const Policy& policy);
+
+// The policy of each track of the device, in the order of device.get_tracks(). Throws on invalid
+// settings.
+std::vector<Policy> policies(const nlohmann::json& config, const device::Device& device);
+} // namespace lmgd::source::compression
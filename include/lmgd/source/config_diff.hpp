@@ -0,0 +1,22 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+namespace lmgd::source
+{
+
+// What it takes to apply a new config, ordered by cost
+enum class ConfigChange
+{
+    // nothing changed
+    none,
+    // only names, chunk sizes, the frame queue or metadata, which don't concern the device
+    host,
+    // additionally current or voltage ranges of channels, which need a few commands to the device
+    ranges,
+    // anything else, e.g., tracks or the measurement mode, needs the whole device setup
+    full
+};
+
+ConfigChange diff(const nlohmann::json& old_config, const nlohmann::json& new_config);
+} // namespace lmgd::source
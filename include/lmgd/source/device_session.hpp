@@ -0,0 +1,270 @@
+#pragma once
+
+#include <lmgd/source/config_diff.hpp>
+#include <lmgd/source/device_thread.hpp>
+#include <lmgd/source/frame_times.hpp>
+#include <lmgd/source/handover.hpp>
+#include <lmgd/source/metric.hpp>
+#include <lmgd/source/queue_policy.hpp>
+#include <lmgd/source/stats.hpp>
+
+#include <lmgd/alloc_counter.hpp>
+#include <lmgd/network/callback.hpp>
+#include <lmgd/network/data.hpp>
+#include <lmgd/network/gapless_frame.hpp>
+#include <lmgd/span.hpp>
+#include <lmgd/spsc_queue.hpp>
+#include <lmgd/timer_wheel.hpp>
+
+#include <metricq/source.hpp>
+#include <metricq/timer.hpp>
+
+#include <asio/basic_waitable_timer.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lmgd::device
+{
+class Device;
+}
+
+namespace lmgd::source
+{
+class Source;
+
+struct OffsetMetrics
+{
+    OffsetMetrics(metricq::Source& source, const std::string& base_metric)
+    : local_offset(source[base_metric + ".local_offset"]),
+      chunk_offset(source[base_metric + ".chunk_offset"])
+    {
+    }
+
+    metricq::Metric<metricq::Source>& local_offset;
+    metricq::Metric<metricq::Source>& chunk_offset;
+};
+
+// A frame handed over from the device thread to the MetricQ thread
+struct QueuedFrame
+{
+    enum class Type
+    {
+        binary,
+        ascii,
+        end_of_stream,
+        // we stopped reading for another process to take over, see DeviceSession::hand_over
+        handover
+    };
+
+    Type type;
+    // time of reception, as there are no timestamps in cycle mode
+    metricq::TimePoint time;
+    // binary frames are passed as they are, the buffer returns to the frame pool once released
+    std::shared_ptr<network::BinaryData> data;
+    // ascii lines are parsed on the device thread, one value per track
+    std::vector<float> values;
+    // frames were dropped right before this one
+    bool gap = false;
+};
+
+// Everything about one device: its connection and thread, the recording and its metrics. The
+// sessions of all devices publish through the same Source, but a failing device only takes its own
+// session down.
+//
+// All methods are called on the MetricQ thread, unless stated otherwise.
+class DeviceSession
+{
+public:
+    DeviceSession(Source& source, bool drop_data);
+    ~DeviceSession();
+
+    DeviceSession(const DeviceSession&) = delete;
+    DeviceSession& operator=(const DeviceSession&) = delete;
+
+public:
+    // The config of this device only, see device_configs()
+    void on_source_config(const nlohmann::json& config);
+    void on_source_ready();
+    // The connection to MetricQ is gone
+    void on_connection_lost();
+
+    // Stops the recording for good. Check Source::session_stopped() afterwards.
+    void request_stop();
+    // Stops, as the device isn't in the config anymore. A later config may bring it back.
+    void retire();
+    // Neither recording nor going to
+    bool finished() const
+    {
+        return device_state_ == DeviceState::none && stop_requested_;
+    }
+    bool recording() const
+    {
+        return device_state_ == DeviceState::recording;
+    }
+
+    // The Source can only drop all metrics at once, so it rebuilds the metrics of all sessions
+    // together, see Source::rebuild_metrics(). A running recording goes on seamlessly.
+    void release_metrics();
+    void setup_metrics();
+
+private:
+    void setup_device();
+    void update_device();
+    void on_device_ready();
+    void start_watchdog();
+    void resume_recording();
+
+    // Gives up on the device and sets it up again after a backoff
+    void on_device_error(std::exception_ptr error);
+    void disconnect();
+    void schedule_reconnect();
+
+    void stop_recording();
+
+    // Passing the recording on to another process, see handover.hpp
+    void listen_for_handover();
+    void on_handover_request(std::shared_ptr<HandoverRequest> request);
+    void decline_handover(const std::string& reason);
+    void hand_over();
+
+    // Called on the device thread
+    bool try_take_over(const nlohmann::json& config);
+    network::CallbackResult on_binary_frame(std::shared_ptr<network::BinaryData>& data);
+    network::CallbackResult on_ascii_line(std::string_view line);
+    network::CallbackResult next_frame();
+    // Applies the queue policy, if the queue is full. Returns nullptr, if the frame is dropped.
+    QueuedFrame* prepare_frame();
+    network::CallbackResult end_stream(QueuedFrame::Type type = QueuedFrame::Type::end_of_stream);
+    // Blocks until there is room in the queue. Returns nullptr, if the wait was given up, see
+    // wake_producer().
+    QueuedFrame* wait_for_room();
+    void notify();
+    void track_latency();
+    void start_stream();
+
+    // Called on the MetricQ thread
+    void drain();
+    void drop_oldest_frames();
+    // Wakes the device thread in wait_for_room(), after making room or requesting a stop or a
+    // handover. Called on any thread.
+    void wake_producer();
+    bool degraded();
+    bool skip_degraded();
+    void process_frame(network::BinaryData& data, metricq::TimePoint time, bool gap, bool degraded);
+    void process_values(metricq::TimePoint time, const std::vector<float>& values, bool degraded);
+    // Flushes or schedules the flush of the metric after a frame
+    void end_frame(std::size_t index);
+    void on_flush_due(std::size_t index);
+    // Takes the mean of every decimation_ samples
+    void decimate(const std::vector<time::TimePoint>& times, Span<const float> values);
+    void on_end_of_stream();
+    void log_prefix(const nlohmann::json& config);
+
+    static constexpr std::size_t frame_queue_size = 64;
+    // The end of a stream always gets a slot, so it never waits for the MetricQ thread
+    static constexpr std::size_t end_of_stream_slots = 1;
+
+    enum class DeviceState
+    {
+        none,
+        setup,
+        recording,
+        // waiting for the old device to be torn down or for the next attempt to set it up
+        reconnecting,
+        // passing the device on to another process, we stop afterwards
+        handing_over
+    };
+
+private:
+    Source& source_;
+    // of the MetricQ thread
+    asio::io_service& io_service_;
+    // The serial of the device, so the logs tell the devices apart
+    std::string log_prefix_;
+    std::mutex config_mutex_;
+    metricq::Timer timer_;
+    asio::steady_timer reconnect_timer_;
+    // Flushes the metrics by their max_age, the ids are indices into lmg_metrics_
+    TimerWheel flush_wheel_;
+    DeviceThread device_thread_;
+    // Owned by the device thread, but only set or reset, while no handlers of the device are
+    // pending.
+    std::unique_ptr<lmgd::device::Device> device_;
+    SpscQueue<QueuedFrame> frames_;
+    std::atomic<bool> drain_scheduled_ = false;
+    std::vector<lmgd::source::Metric> lmg_metrics_;
+    std::vector<OffsetMetrics> offset_metrics_;
+    nlohmann::json config_;
+    std::atomic<bool> stop_requested_ = false;
+    // Only used on the MetricQ thread
+    DeviceState device_state_ = DeviceState::none;
+    bool restart_requested_ = false;
+    // Not in the config anymore
+    bool retired_ = false;
+    // The device is set up and can be accessed for the metrics, see setup_metrics()
+    bool metrics_active_ = false;
+    // What the restart after the currently stopping recording has to do
+    ConfigChange pending_change_ = ConfigChange::none;
+    int reconnect_attempts_ = 0;
+    std::uint64_t reconnects_ = 0;
+    std::optional<std::chrono::steady_clock::time_point> disconnected_since_;
+    double disconnected_time_ = 0;
+    double lost_samples_ = 0;
+    std::minstd_rand random_{ std::random_device()() };
+    std::unique_ptr<HandoverListener> handover_listener_;
+    // The request we are about to accept
+    std::shared_ptr<HandoverRequest> handover_;
+    // Tells the device thread to stop reading at the next frame boundary
+    std::atomic<bool> handover_requested_ = false;
+    // The state of the metrics taken over from another process, set on the device thread before
+    // on_device_ready
+    nlohmann::json taken_over_metrics_;
+    // The state of the metrics to restore in setup_metrics(), by their name
+    nlohmann::json metric_states_;
+    bool drop_data_;
+    device::MeasurementMode measurement_mode_;
+    Stats stats_;
+    // The timestamps of the samples in gapless frames, shared by all tracks
+    FrameTimes frame_times_;
+    // The frame being processed, its arena is reused for the next one
+    network::GaplessFrame gapless_frame_;
+    std::atomic<std::uint64_t> damaged_frames_ = 0;
+    std::atomic<std::uint64_t> dropped_frames_ = 0;
+    std::atomic<QueuePolicy> queue_policy_ = QueuePolicy::drop_newest;
+    // The device thread waits for the MetricQ thread to drop the oldest frames
+    std::atomic<bool> overflow_ = false;
+    std::mutex room_mutex_;
+    std::condition_variable room_available_;
+    std::atomic<bool> waiting_for_room_ = false;
+    // Only used on the MetricQ thread
+    int decimation_ = 10;
+    bool degraded_ = false;
+    // Frames were dropped before the next one to process
+    bool gap_ = false;
+    std::uint64_t degraded_frames_ = 0;
+    std::vector<time::TimePoint> decimated_times_;
+    std::vector<float> decimated_values_;
+    alloc::Tracker alloc_tracker_;
+    std::uint64_t frame_count_ = 0;
+    // Only the first setup may take over from another process, later on it is gone
+    bool take_over_ = true;
+    // Frames were dropped before the next one to queue
+    bool frames_lost_ = false;
+    std::chrono::steady_clock::time_point recording_started_;
+    std::chrono::steady_clock::time_point last_frame_;
+    // The longest gap between two frames since the stats were published last, in us
+    std::atomic<std::uint64_t> frame_interval_max_ = 0;
+};
+
+} // namespace lmgd::source
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <lmgd/log.hpp>
+
+#include <asio/io_service.hpp>
+#include <asio/post.hpp>
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace lmgd::source
+{
+
+// A thread with its own io_service for everything talking to the device, so that reading from the
+// device doesn't stall, while the MetricQ connection is busy.
+class DeviceThread
+{
+public:
+    // Called on the device thread with exceptions escaping from handlers on its io_service
+    using ErrorHandler = std::function<void(std::exception_ptr)>;
+
+    explicit DeviceThread(ErrorHandler on_error)
+    : work_(std::in_place, io_service_),
+      on_error_(std::move(on_error)),
+      thread_([this]() { run(); })
+    {
+    }
+
+    ~DeviceThread()
+    {
+        work_.reset();
+        io_service_.stop();
+        thread_.join();
+    }
+
+    DeviceThread(const DeviceThread&) = delete;
+    DeviceThread& operator=(const DeviceThread&) = delete;
+
+public:
+    asio::io_service& io_service()
+    {
+        return io_service_;
+    }
+
+    template <typename F>
+    void post(F&& f)
+    {
+        asio::post(io_service_, std::forward<F>(f));
+    }
+
+    // Runs f on the device thread and waits for it. Exceptions are rethrown to the caller.
+    template <typename F>
+    auto run(F&& f)
+    {
+        using Result = std::invoke_result_t<F>;
+
+        std::packaged_task<Result()> task(std::forward<F>(f));
+        auto result = task.get_future();
+        post([&task]() { task(); });
+
+        return result.get();
+    }
+
+private:
+    void run()
+    {
+        while (true)
+        {
+            try
+            {
+                io_service_.run();
+                return;
+            }
+            catch (...)
+            {
+                Log::error() << "Caught exception on the device thread";
+                on_error_(std::current_exception());
+            }
+        }
+    }
+
+private:
+    asio::io_service io_service_;
+    std::optional<asio::io_service::work> work_;
+    ErrorHandler on_error_;
+    std::thread thread_;
+};
+} // namespace lmgd::source
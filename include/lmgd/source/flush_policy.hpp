@@ -0,0 +1,42 @@
+#pragma once
+
+#include <lmgd/device/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace lmgd::source
+{
+
+// When the buffered samples of a metric are sent as a chunk. The default for all metrics is
+//
+//   "flush": { "max_age": 0.2, "max_size": 100000 }
+//
+// and channels may set it per metric, see track_settings.hpp. Without any, the chunk_size is the
+// max_size as lmgd always did.
+struct FlushPolicy
+{
+    // Flush, once that many samples are buffered, 0 for no limit
+    std::size_t max_size = 0;
+    // Flush at most that long (in seconds in the config) after the first sample was buffered
+    std::optional<std::chrono::nanoseconds> max_age;
+
+    // Neither is set, so flush after each frame, like a chunk_size of 0
+    bool every_frame() const
+    {
+        return max_size == 0 && !max_age;
+    }
+};
+
+// The policy of each track of the device, in the order of device.get_tracks(). Throws on invalid
+// settings.
+std::vector<FlushPolicy> flush_policies(const nlohmann::json& config, const device::Device& device);
+
+// How precise the max_age of the policies has to be kept: a tenth of the shortest, but between
+// 1 and 10 ms
+std::chrono::nanoseconds flush_tick(const std::vector<FlushPolicy>& policies);
+} // namespace lmgd::source
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <lmgd/time.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace lmgd::source
+{
+
+// The timestamps of the samples in a gapless frame. Sample i of n in a cycle of duration d is at
+// start + floor(i * d / n), so the samples are spread evenly and exactly, and the next cycle
+// starts right after the last sample.
+//
+// All tracks of a frame usually have the same number of samples and the same start, so the times
+// are computed once and shared. The offsets into the cycle are cached as long as the cycle
+// duration stays the same, which it does for a running recording.
+class FrameTimes
+{
+public:
+    const std::vector<time::TimePoint>& get(time::TimePoint start, time::Duration duration,
+                                            std::size_t samples)
+    {
+        if (duration != duration_)
+        {
+            // Keeps the buffers, in case the duration jitters
+            duration_ = duration;
+            for (auto& entry : entries_)
+            {
+                offsets(duration_, entry.samples, entry.offsets);
+                entry.valid = false;
+            }
+        }
+
+        auto& entry = find(samples);
+        if (!entry.valid || entry.start != start)
+        {
+            entry.start = start;
+            entry.valid = true;
+            add(start, entry.offsets, entry.times);
+        }
+        return entry.times;
+    }
+
+    // Computes the offsets of the samples in a cycle without any division per sample, but with the
+    // same result as floor(i * duration / samples).
+    static void offsets(time::Duration duration, std::size_t samples,
+                        std::vector<time::Duration>& offsets)
+    {
+        assert(duration.count() >= 0);
+
+        offsets.resize(samples);
+        if (samples == 0)
+        {
+            return;
+        }
+
+        const auto n = static_cast<time::Duration::rep>(samples);
+        const auto step = duration.count() / n;
+        const auto remainder = duration.count() % n;
+
+        time::Duration::rep offset = 0;
+        time::Duration::rep error = 0;
+        for (auto& o : offsets)
+        {
+            o = time::Duration(offset);
+
+            offset += step;
+            error += remainder;
+            if (error >= n)
+            {
+                error -= n;
+                ++offset;
+            }
+        }
+    }
+
+    // times[i] = start + offsets[i], a plain loop over 64 bit integers, which the compiler
+    // vectorizes
+    static void add(time::TimePoint start, const std::vector<time::Duration>& offsets,
+                    std::vector<time::TimePoint>& times)
+    {
+        times.resize(offsets.size());
+
+        const auto base = start.time_since_epoch().count();
+        const auto* in = offsets.data();
+        auto* out = times.data();
+        for (std::size_t i = 0; i < offsets.size(); i++)
+        {
+            out[i] = time::TimePoint(time::Duration(base + in[i].count()));
+        }
+    }
+
+private:
+    struct Entry
+    {
+        std::size_t samples;
+        std::vector<time::Duration> offsets;
+        // times are for this start
+        bool valid = false;
+        time::TimePoint start;
+        std::vector<time::TimePoint> times;
+    };
+
+    Entry& find(std::size_t samples)
+    {
+        // Only as many entries as there are different sample counts per track, usually one
+        for (auto& entry : entries_)
+        {
+            if (entry.samples == samples)
+            {
+                return entry;
+            }
+        }
+
+        auto& entry = entries_.emplace_back();
+        entry.samples = samples;
+        offsets(duration_, samples, entry.offsets);
+        return entry;
+    }
+
+private:
+    time::Duration duration_{ -1 };
+    std::vector<Entry> entries_;
+};
+} // namespace lmgd::source
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <lmgd/device/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <asio/io_service.hpp>
+#include <asio/local/stream_protocol.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace lmgd::source
+{
+
+// Passes a running recording from an old lmgd process to a new one, e.g., when upgrading lmgd, so
+// the device is neither reset nor stopped. Both talk over a unix domain socket:
+//
+// 1. The new process connects and sends its config.
+// 2. The old process stops reading at the next frame boundary and publishes everything up to it.
+// 3. It answers with the state of the device and the metrics, followed by the bytes it already
+//    received after that frame boundary. The connection to the device is attached (SCM_RIGHTS).
+//    Or it declines with {"error": "..."}.
+//
+// Each message is JSON prefixed with its 32 bit length, the buffered bytes are prefixed the same.
+
+// A handover, which a new process asked for. Always held by a shared_ptr.
+class HandoverRequest : public std::enable_shared_from_this<HandoverRequest>
+{
+public:
+    HandoverRequest(asio::local::stream_protocol::socket socket, nlohmann::json config);
+
+public:
+    const nlohmann::json& config() const
+    {
+        return config_;
+    }
+
+    // Doesn't block, the answer is sent in the background, if the other process reads it at all
+    void decline(const std::string& reason);
+
+    // Passes the device on along with the state of the metrics, see Metric::state(). Blocks until
+    // everything is sent. Closes our duplicate of the connection to the device in any case.
+    void accept(device::Handover handover, const nlohmann::json& metrics);
+
+private:
+    asio::local::stream_protocol::socket socket_;
+    nlohmann::json config_;
+    std::string answer_;
+};
+
+// Waits for new processes to ask for the recording
+class HandoverListener
+{
+public:
+    using Handler = std::function<void(std::shared_ptr<HandoverRequest>)>;
+
+    // Replaces a stale socket at path, e.g., of the process we took over from. Only processes of
+    // the same user may connect.
+    HandoverListener(asio::io_service& io_service, const std::string& path, Handler handler);
+
+private:
+    void accept();
+
+private:
+    asio::io_service& io_service_;
+    asio::local::stream_protocol::acceptor acceptor_;
+    Handler handler_;
+};
+
+// What the new process gets
+struct TakenOver
+{
+    device::Handover device;
+    // The state of each metric by its name
+    nlohmann::json metrics;
+};
+
+// Asks the process listening at path to hand over its recording. Returns nothing, if there is no
+// such process or it declined.
+std::optional<TakenOver> take_over(const std::string& path, const nlohmann::json& config,
+                                   std::chrono::milliseconds timeout);
+} // namespace lmgd::source
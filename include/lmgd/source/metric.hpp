@@ -2,11 +2,25 @@
 
 #include <lmgd/device/track.hpp>
 #include <lmgd/device/types.hpp>
+#include <lmgd/source/compression.hpp>
+#include <lmgd/source/flush_policy.hpp>
+#include <lmgd/span.hpp>
 #include <lmgd/time.hpp>
 
 #include <metricq/metric.hpp>
 #include <metricq/source.hpp>
 
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
 #include <cassert>
 
 namespace lmgd::source
@@ -14,11 +28,18 @@ namespace lmgd::source
 class Metric
 {
 public:
+    using Clock = std::chrono::steady_clock;
+
+    // Builds the chunks itself and sends them through source. Only flushes by itself for the
+    // max_size of the policy, the caller takes care of the rest, see take_deadline().
     Metric(
         const device::Track& track,
         metricq::Metric<metricq::Source>& metric,
-        int max_repeats = 8)
-    : metric_(metric), bandwidth_(track.bandwidth()), max_repeats_(max_repeats)
+        metricq::Source& source,
+        FlushPolicy flush_policy,
+        compression::Policy policy)
+    : metric_(metric), source_(source), bandwidth_(track.bandwidth()), policy_(std::move(policy)),
+      flush_policy_(flush_policy)
     {
         metric.metadata(metricq::Metadata::Scope::last);
 
@@ -79,28 +100,78 @@ public:
 public:
     void send(metricq::TimePoint tp, float value)
     {
-        if (device::MetricBandwidth::wide == bandwidth_ ||
-            device::MetricBandwidth::cycle == bandwidth_)
+        ++samples_in_;
+
+        std::visit(
+            [this, tp, value](auto& policy) { add(policy, tp.time_since_epoch().count(), value); },
+            policy_);
+    }
+
+    // All samples of a track in a frame at once, with times[i] being the time of values[i]
+    void send(const std::vector<time::TimePoint>& times, Span<const float> values)
+    {
+        assert(times.size() == values.size());
+
+        send(times.data(), values.data(), values.size());
+    }
+
+    void send(const time::TimePoint* times, const float* values, std::size_t size)
+    {
+        samples_in_ += size;
+
+        std::visit(
+            [this, times, values, size](auto& policy) { send(policy, times, values, size); },
+            policy_);
+    }
+
+    void flush()
+    {
+        if (chunk_.value_size() == 0)
         {
-            metric_.send({ tp, value });
             return;
         }
 
-        if (value == last_value_ && repeat_ < max_repeats_)
-        {
-            ++repeat_;
-        }
-        else
+        source_.send(metric_.id(), chunk_);
+        // keeps the memory for the next chunk
+        chunk_.Clear();
+        previous_time_ = 0;
+        deadline_.reset();
+    }
+
+    // The stream ends, so the policy publishes what it holds back, and the chunk goes out
+    void finish()
+    {
+        std::visit(
+            [this](auto& policy) {
+                policy.finish([this](std::int64_t time, float value) { append(time, value); });
+            },
+            policy_);
+        flush();
+    }
+
+    const FlushPolicy& flush_policy() const
+    {
+        return flush_policy_;
+    }
+
+    // When the chunk has to go out by the max_age of the policy. Only given once per chunk, so it
+    // is scheduled once.
+    std::optional<Clock::time_point> take_deadline()
+    {
+        if (!deadline_ || deadline_taken_)
         {
-            repeat_ = 0;
-            last_value_ = value;
-            metric_.send({ tp, value });
+            return std::nullopt;
         }
+        deadline_taken_ = true;
+        return deadline_;
     }
 
-    void flush()
+    void flush_if_due(Clock::time_point time)
     {
-        metric_.flush();
+        if (deadline_ && *deadline_ <= time)
+        {
+            flush();
+        }
     }
 
     time::TimePoint cycle_start(time::TimePoint cycle_time)
@@ -117,14 +188,181 @@ public:
         current_cycle_time_ = cycle_time;
     }
 
+    // After lost frames, the next cycle doesn't continue the last one
+    void restart_cycle()
+    {
+        current_cycle_time_ = time::TimePoint();
+    }
+
+    const std::string& name() const
+    {
+        return metric_.id();
+    }
+
+    const char* compression() const
+    {
+        return compression::name(policy_);
+    }
+
+    // Samples passed to send() and actually published
+    std::uint64_t samples_in() const
+    {
+        return samples_in_;
+    }
+
+    std::uint64_t samples_out() const
+    {
+        return samples_out_;
+    }
+
+    // Everything needed to go on seamlessly in another process, see restore()
+    nlohmann::json state() const
+    {
+        nlohmann::json state;
+        state["cycle_time"] = current_cycle_time_.time_since_epoch().count();
+        state["compression"]["policy"] = compression();
+        state["compression"]["state"] =
+            std::visit([](const auto& policy) { return policy.state(); }, policy_);
+        return state;
+    }
+
+    void restore(const nlohmann::json& state)
+    {
+        current_cycle_time_ =
+            time::TimePoint(time::Duration(state.at("cycle_time").get<time::Duration::rep>()));
+
+        // The policy might have changed with the config, then it just starts over
+        auto it = state.find("compression");
+        if (it != state.end() && it->at("policy").get<std::string>() == compression())
+        {
+            std::visit([&it](auto& policy) { policy.restore(it->at("state")); }, policy_);
+        }
+    }
+
+private:
+    template <typename Policy>
+    void add(Policy& policy, std::int64_t time, float value)
+    {
+        policy.add(time, value, [this](std::int64_t time, float value) { append(time, value); });
+    }
+
+    // The first sample of a chunk starts its max_age
+    void start_chunk()
+    {
+        if (flush_policy_.max_age)
+        {
+            deadline_ = Clock::now() + *flush_policy_.max_age;
+            deadline_taken_ = false;
+        }
+    }
+
+    void append(std::int64_t time, float value)
+    {
+        if (chunk_.value_size() == 0)
+        {
+            start_chunk();
+        }
+
+        chunk_.add_time_delta(time - previous_time_);
+        chunk_.add_value(value);
+        previous_time_ = time;
+        ++samples_out_;
+
+        const auto max_size = flush_policy_.max_size;
+        if (max_size && static_cast<std::size_t>(chunk_.value_size()) >= max_size)
+        {
+            flush();
+        }
+    }
+
+    template <typename Policy>
+    void send(Policy& policy, const time::TimePoint* times, const float* values, std::size_t size)
+    {
+        // Room for the case, that nothing is left out
+        auto space = size;
+        if (flush_policy_.max_size)
+        {
+            space = std::min(space, flush_policy_.max_size - chunk_.value_size());
+        }
+        chunk_.mutable_time_delta()->Reserve(static_cast<int>(chunk_.value_size() + space));
+        chunk_.mutable_value()->Reserve(static_cast<int>(chunk_.value_size() + space));
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            add(policy, times[i].time_since_epoch().count(), values[i]);
+        }
+    }
+
+    // Without any policy, the samples are written to the chunk in place, with the timestamps delta
+    // encoded as MetricQ wants them. Splits them into chunks of max_size, if set.
+    void send(
+        compression::None&,
+        const time::TimePoint* times,
+        const float* values,
+        std::size_t size)
+    {
+        const auto max_size = flush_policy_.max_size;
+
+        while (size > 0)
+        {
+            auto* time_deltas = chunk_.mutable_time_delta();
+            auto* chunk_values = chunk_.mutable_value();
+            const std::size_t used = chunk_values->size();
+            if (used == 0)
+            {
+                start_chunk();
+            }
+
+            auto space = size;
+            if (max_size)
+            {
+                space = std::min(space, max_size - used);
+            }
+
+            time_deltas->Reserve(static_cast<int>(used + space));
+            chunk_values->Reserve(static_cast<int>(used + space));
+            auto* out_times = time_deltas->AddNAlreadyReserved(static_cast<int>(space));
+            auto* out_values = chunk_values->AddNAlreadyReserved(static_cast<int>(space));
+
+            auto previous = previous_time_;
+            for (std::size_t i = 0; i < space; i++)
+            {
+                const auto time = times[i].time_since_epoch().count();
+                out_times[i] = time - previous;
+                out_values[i] = values[i];
+                previous = time;
+            }
+            previous_time_ = previous;
+            samples_out_ += space;
+
+            times += space;
+            values += space;
+            size -= space;
+
+            if (max_size && static_cast<std::size_t>(chunk_values->size()) >= max_size)
+            {
+                flush();
+            }
+        }
+    }
+
 private:
     metricq::Metric<metricq::Source>& metric_;
+    metricq::Source& source_;
 
     device::MetricBandwidth bandwidth_;
+    compression::Policy policy_;
+
+    metricq::DataChunk chunk_;
+    FlushPolicy flush_policy_;
+    // of the last sample in chunk_, or 0 for the first
+    std::int64_t previous_time_ = 0;
+    // of chunk_ by the max_age
+    std::optional<Clock::time_point> deadline_;
+    bool deadline_taken_ = false;
 
-    int max_repeats_;
-    float last_value_;
-    int repeat_ = 0;
+    std::uint64_t samples_in_ = 0;
+    std::uint64_t samples_out_ = 0;
 
     time::TimePoint current_cycle_time_;
 };
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+namespace lmgd::source
+{
+
+// What happens to frames, if the MetricQ thread doesn't keep up and the frame queue runs full.
+// Configured by
+//
+//   "frame_queue": { "policy": "drop_oldest", "decimation": 10 }
+enum class QueuePolicy
+{
+    // drops the frames coming in, what lmgd always did
+    drop_newest,
+    // drops the frames queued the longest, so the published data stays recent
+    drop_oldest,
+    // stops reading from the device until there is room again. Nothing is lost in lmgd, but the
+    // device may overrun.
+    block,
+    // once the queue is backed up, only publishes the mean of each decimation samples in gapless
+    // mode, or every decimation-th frame in cycle mode, until it caught up. Drops the oldest
+    // frames, if even that isn't enough.
+    decimate
+};
+
+struct QueueSettings
+{
+    QueuePolicy policy = QueuePolicy::drop_newest;
+    int decimation = 10;
+};
+
+// Throws on invalid settings
+QueueSettings queue_settings(const nlohmann::json& config);
+} // namespace lmgd::source
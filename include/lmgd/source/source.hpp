@@ -1,65 +1,59 @@
 #pragma once
 
-#include <lmgd/source/metric.hpp>
+#include <lmgd/source/device_session.hpp>
 
 #include <metricq/source.hpp>
-#include <metricq/timer.hpp>
 
-#include <asio/basic_waitable_timer.hpp>
+#include <nlohmann/json.hpp>
+
 #include <asio/signal_set.hpp>
 
-#include <atomic>
+#include <map>
 #include <memory>
-#include <mutex>
+#include <string>
 #include <vector>
 
-namespace lmgd::device
-{
-class Device;
-}
-
 namespace lmgd::source
 {
 
-struct OffsetMetrics
-{
-    OffsetMetrics(metricq::Source& source, const std::string& base_metric)
-    : local_offset(source[base_metric + ".local_offset"]),
-      chunk_offset(source[base_metric + ".chunk_offset"])
-    {
-    }
-
-    metricq::Metric<metricq::Source>& local_offset;
-    metricq::Metric<metricq::Source>& chunk_offset;
-};
-
+// Publishes the data of all devices in the config through one connection to MetricQ. Each device
+// has its own DeviceSession with its own connection and thread, so the devices are set up and read
+// in parallel, and one failing device doesn't affect the others.
 class Source : public metricq::Source
 {
 public:
     Source(const std::string& server, const std::string& token, bool drop_data);
-    ~Source();
 
     void on_source_config(const nlohmann::json& config) override;
     void on_source_ready() override;
 
+public:
+    // Called by the sessions
+    bool source_ready() const
+    {
+        return source_ready_;
+    }
+
+    // Sets up the metrics of all sessions again, as the metrics can only be cleared all at once.
+    // The recordings of the other sessions go on seamlessly.
+    void rebuild_metrics();
+
+    // Stops, once all sessions are finished
+    void session_stopped();
+
 protected:
     void on_error(const std::string& message) override;
     void on_closed() override;
 
 private:
-    void setup_device();
-
-private:
-    std::mutex config_mutex_;
     asio::signal_set signals_;
-    metricq::Timer timer_;
-    std::unique_ptr<lmgd::device::Device> device_;
-    std::vector<lmgd::source::Metric> lmg_metrics_;
-    std::vector<OffsetMetrics> offset_metrics_;
-    nlohmann::json config_;
-    std::atomic<bool> stop_requested_ = false;
     bool drop_data_;
-    int chunk_size_;
+    bool stop_requested_ = false;
+    // The MetricQ handshake is done and we can publish
+    bool source_ready_ = false;
+    // One per device, by device_key(). The sessions of devices removed from the config are kept,
+    // so nothing posted for them outlives them. A later config for the same device uses them again.
+    std::map<std::string, std::unique_ptr<DeviceSession>> sessions_;
 };
 
 } // namespace lmgd::source
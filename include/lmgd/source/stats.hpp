@@ -0,0 +1,91 @@
+#pragma once
+
+#include <lmgd/log.hpp>
+
+#include <metricq/metric.hpp>
+#include <metricq/source.hpp>
+#include <metricq/timer.hpp>
+
+#include <asio/io_service.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace lmgd::source
+{
+
+// Periodically publishes internal counters of lmgd, like resynchronizations of the data stream, as
+// metrics.
+class Stats
+{
+public:
+    using Getter = std::function<double()>;
+
+    Stats(metricq::Source& source, asio::io_service& io_service)
+    : source_(source), timer_(io_service)
+    {
+    }
+
+public:
+    // All metrics will be named <prefix>.<name>
+    void prefix(const std::string& prefix)
+    {
+        prefix_ = prefix;
+    }
+
+    void add(const std::string& name, const std::string& unit, Getter getter)
+    {
+        auto& metric = source_[prefix_ + "." + name];
+        metric.metadata.unit(unit);
+        metric.metadata.rate(1. / interval_.count());
+        metric.metadata(metricq::Metadata::Scope::last);
+
+        Log::debug() << "Add stats metric: " << prefix_ << "." << name;
+
+        entries_.push_back({ &metric, std::move(getter) });
+    }
+
+    void start()
+    {
+        timer_.start(
+            [this](auto) {
+                this->publish();
+                return metricq::Timer::TimerResult::repeat;
+            },
+            interval_);
+    }
+
+    // Must be called before the metrics are cleared from the source
+    void clear()
+    {
+        timer_.cancel();
+        entries_.clear();
+    }
+
+private:
+    void publish()
+    {
+        auto now = metricq::Clock::now();
+        for (auto& entry : entries_)
+        {
+            entry.metric->send({ now, entry.getter() });
+            entry.metric->flush();
+        }
+    }
+
+private:
+    struct Entry
+    {
+        metricq::Metric<metricq::Source>* metric;
+        Getter getter;
+    };
+
+    metricq::Source& source_;
+    metricq::Timer timer_;
+    std::string prefix_ = "lmgd";
+    std::chrono::seconds interval_ = std::chrono::seconds(1);
+    std::vector<Entry> entries_;
+};
+} // namespace lmgd::source
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <lmgd/device/track.hpp>
+#include <lmgd/device/types.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <string>
+
+namespace lmgd::source
+{
+// Channels may set some things per metric, e.g.,
+//
+//   "compression": {
+//       "default": { ... },
+//       "power@narrow": { ... }
+//   }
+//
+// with the keys being "default" or metrics as given in "metrics".
+
+// Throws, if a key doesn't name a metric recorded by the channel. Typos would go unnoticed
+// otherwise.
+void check_track_settings(
+    const nlohmann::json& config,
+    const std::string& key,
+    device::MeasurementMode mode);
+
+// The setting of the track, the default of its channel, or else fallback
+nlohmann::json track_setting(
+    const nlohmann::json& config,
+    const std::string& key,
+    const device::Track& track,
+    device::MeasurementMode mode,
+    const nlohmann::json& fallback);
+} // namespace lmgd::source
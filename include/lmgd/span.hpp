@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+namespace lmgd
+{
+
+// A view of size consecutive values owned by someone else, like std::span in C++20
+template <typename T>
+class Span
+{
+public:
+    Span() = default;
+
+    Span(T* data, std::size_t size) : data_(data), size_(size)
+    {
+    }
+
+    T* data() const
+    {
+        return data_;
+    }
+
+    T* begin() const
+    {
+        return data_;
+    }
+
+    T* end() const
+    {
+        return data_ + size_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    T& operator[](std::size_t index) const
+    {
+        assert(index < size_);
+        return data_[index];
+    }
+
+private:
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+} // namespace lmgd
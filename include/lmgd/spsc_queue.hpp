@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace lmgd
+{
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+//
+// The slots are allocated once and reused, so the producer fills a slot in place with prepare() and
+// commit(), and the consumer reads it in place with front() and pop(). Members of T, e.g. vectors,
+// keep their capacity across reuses.
+template <typename T>
+class SpscQueue
+{
+public:
+    // The capacity is rounded up to the next power of two
+    explicit SpscQueue(std::size_t capacity) : slots_(round_up(capacity)), mask_(slots_.size() - 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+public:
+    // Producer: returns the next free slot or nullptr, if the queue is full. The last reserved
+    // slots are left free, e.g., for a message which must not wait for room.
+    T* prepare(std::size_t reserved = 0)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ + reserved >= slots_.size())
+        {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ + reserved >= slots_.size())
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    // Producer: publishes the slot returned by the previous prepare()
+    void commit()
+    {
+        auto tail = tail_.load(std::memory_order_relaxed) + 1;
+        tail_.store(tail, std::memory_order_release);
+
+        // The cached head may be far behind, which would make the depth grow up to the capacity
+        head_cache_ = head_.load(std::memory_order_acquire);
+        auto depth = tail - head_cache_;
+        if (depth > high_water_mark_.load(std::memory_order_relaxed))
+        {
+            high_water_mark_.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    // Consumer: returns the oldest slot or nullptr, if the queue is empty
+    T* front()
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_)
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_)
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    // Consumer: releases the slot returned by front() to the producer
+    void pop()
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        assert(head != tail_.load(std::memory_order_relaxed));
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+public:
+    // Both are only a snapshot, if called concurrently to the producer or consumer
+    std::size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    std::size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+    // The highest number of queued elements so far, as seen by the producer right after a commit()
+    std::size_t high_water_mark() const
+    {
+        return high_water_mark_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static std::size_t round_up(std::size_t capacity)
+    {
+        std::size_t result = 1;
+        while (result < capacity)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+private:
+    std::vector<T> slots_;
+    std::size_t mask_;
+
+    // The indices grow monotonically, each side caches the last seen index of the other side.
+    alignas(64) std::atomic<std::size_t> head_ = 0;
+    std::size_t tail_cache_ = 0;
+
+    alignas(64) std::atomic<std::size_t> tail_ = 0;
+    std::size_t head_cache_ = 0;
+    std::atomic<std::size_t> high_water_mark_ = 0;
+};
+} // namespace lmgd
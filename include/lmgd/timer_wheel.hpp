@@ -0,0 +1,154 @@
+#pragma once
+
+#include <asio/error.hpp>
+#include <asio/io_service.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace lmgd
+{
+
+// Calls handler(id) for scheduled ids once their deadline is near, all with a single timer. The
+// deadlines are rounded down to a multiple of tick, so the handler is called at most one tick
+// early and never late, as long as the io_service keeps up.
+//
+// Scheduling is a push_back into the slot of the deadline. Entries can't be cancelled, the handler
+// has to check, whether the id is still due. Deadlines further out than one round of the wheel just
+// stay in their slot for another round. The timer only runs, while there are entries.
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimerWheel(
+        asio::io_service& io_service,
+        std::function<void(std::size_t)> handler,
+        std::size_t slots = 256)
+    : timer_(io_service), handler_(std::move(handler)), slots_(slots)
+    {
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+public:
+    void schedule(std::size_t id, Clock::time_point deadline)
+    {
+        if (!running_)
+        {
+            running_ = true;
+            start_ = Clock::now();
+            next_ = 0;
+            arm();
+        }
+
+        auto tick = std::max<std::int64_t>(next_, (deadline - start_) / tick_);
+        slots_[tick % slots_.size()].push_back({ id, tick });
+        ++size_;
+    }
+
+    // Drops all entries, e.g., because the ids aren't valid anymore
+    void clear()
+    {
+        timer_.cancel();
+        running_ = false;
+        for (auto& slot : slots_)
+        {
+            slot.clear();
+        }
+        size_ = 0;
+    }
+
+    // Drops all entries as well, they are for the old tick
+    void tick(Clock::duration tick)
+    {
+        clear();
+        tick_ = tick;
+    }
+
+    Clock::duration tick() const
+    {
+        return tick_;
+    }
+
+private:
+    struct Entry
+    {
+        std::size_t id;
+        std::int64_t tick;
+    };
+
+    void arm()
+    {
+        timer_.expires_at(start_ + next_ * tick_);
+        timer_.async_wait([this](auto error) {
+            if (error == asio::error::operation_aborted)
+            {
+                return;
+            }
+            on_tick();
+        });
+    }
+
+    void on_tick()
+    {
+        // Catches up on the ticks we missed
+        const auto now = Clock::now();
+        while (start_ + next_ * tick_ <= now)
+        {
+            auto& slot = slots_[next_ % slots_.size()];
+            for (std::size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].tick <= next_)
+                {
+                    due_.push_back(slot[i].id);
+                    slot[i] = slot.back();
+                    slot.pop_back();
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            ++next_;
+        }
+
+        size_ -= due_.size();
+        // The handler may schedule again
+        for (auto id : due_)
+        {
+            handler_(id);
+        }
+        due_.clear();
+
+        if (size_ > 0)
+        {
+            arm();
+        }
+        else
+        {
+            running_ = false;
+        }
+    }
+
+private:
+    asio::steady_timer timer_;
+    std::function<void(std::size_t)> handler_;
+    Clock::duration tick_ = std::chrono::milliseconds(10);
+    // Keep their capacity, so scheduling doesn't allocate once warmed up
+    std::vector<std::vector<Entry>> slots_;
+    std::vector<std::size_t> due_;
+    std::size_t size_ = 0;
+    bool running_ = false;
+    // tick n of the current run is at start_ + n * tick_
+    Clock::time_point start_;
+    std::int64_t next_ = 0;
+};
+} // namespace lmgd
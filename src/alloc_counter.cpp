@@ -0,0 +1,153 @@
+#include <lmgd/alloc_counter.hpp>
+
+#ifdef LMGD_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+thread_local std::uint64_t allocations = 0;
+
+// Returns nullptr on failure, like malloc
+void* counted_malloc(std::size_t size, std::align_val_t alignment = std::align_val_t(0)) noexcept
+{
+    ++allocations;
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    auto align = static_cast<std::size_t>(alignment);
+    if (align == 0)
+    {
+        return std::malloc(size);
+    }
+
+    // aligned_alloc wants the size to be a multiple of the alignment
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void* checked(void* ptr)
+{
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    return checked(counted_malloc(size));
+}
+
+void* operator new[](std::size_t size)
+{
+    return checked(counted_malloc(size));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return checked(counted_malloc(size, alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return checked(counted_malloc(size, alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, alignment);
+}
+
+// Everything comes from malloc or aligned_alloc, so all of them end up in free
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+namespace lmgd::alloc
+{
+std::uint64_t count()
+{
+#ifdef LMGD_COUNT_ALLOCATIONS
+    return allocations;
+#else
+    return 0;
+#endif
+}
+} // namespace lmgd::alloc
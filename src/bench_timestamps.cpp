@@ -0,0 +1,128 @@
+// Compares computing the timestamps of gapless frames per sample and track, like lmgd used to,
+// with the shared FrameTimes, and reports the time spent per sample.
+//
+//   bench-timestamps --samples 10000 --tracks 8
+
+#include <lmgd/source/frame_times.hpp>
+
+#include <nitro/options/parser.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using lmgd::source::FrameTimes;
+using lmgd::time::Duration;
+using lmgd::time::TimePoint;
+
+namespace
+{
+// Keeps the compiler from dropping the timestamps nobody looks at
+volatile std::int64_t sink;
+
+template <typename Generate>
+double run(const char* name, int frames, int tracks, std::size_t samples, Duration duration,
+           Generate generate)
+{
+    TimePoint start(std::chrono::seconds(1600000000));
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (int track = 0; track < tracks; track++)
+        {
+            sink = generate(start, duration, samples);
+        }
+        start += duration;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    auto ns = std::chrono::duration<double, std::nano>(elapsed).count() /
+              (static_cast<double>(frames) * tracks * samples);
+
+    std::cout << name << ns << " ns/sample\n";
+    return ns;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    nitro::options::parser parser("bench-timestamps");
+
+    parser.option("samples", "Number of samples per track and frame").default_value("10000");
+    parser.option("tracks", "Number of tracks per frame").default_value("8");
+    parser.option("frames", "Number of frames").default_value("2000");
+    parser.option("duration", "Duration of a frame in ns").default_value("100000007");
+    parser.toggle("help").short_name("h");
+
+    try
+    {
+        auto options = parser.parse(argc, argv);
+
+        if (options.given("help"))
+        {
+            parser.usage();
+            return 0;
+        }
+
+        auto samples = std::stoul(options.get("samples"));
+        auto tracks = std::stoi(options.get("tracks"));
+        auto frames = std::stoi(options.get("frames"));
+        auto duration = Duration(std::stoll(options.get("duration")));
+
+        if (samples == 0 || duration.count() <= 0)
+        {
+            throw std::runtime_error("samples and duration must be positive");
+        }
+
+        // Both have to give the very same timestamps
+        FrameTimes check;
+        TimePoint start(std::chrono::seconds(1600000000));
+        const auto& times = check.get(start, duration, samples);
+        for (std::size_t i = 0; i < samples; i++)
+        {
+            if (times[i] != start + i * duration / samples)
+            {
+                throw std::runtime_error("timestamps differ at sample " + std::to_string(i));
+            }
+        }
+
+        std::vector<TimePoint> naive(samples);
+        auto per_sample = run("per sample: ", frames, tracks, samples, duration,
+                              [&naive](TimePoint start, Duration duration, std::size_t samples) {
+                                  for (std::size_t i = 0; i < samples; i++)
+                                  {
+                                      naive[i] = start + i * duration / samples;
+                                  }
+                                  return naive.back().time_since_epoch().count();
+                              });
+
+        FrameTimes frame_times;
+        auto shared = run("shared:     ", frames, tracks, samples, duration,
+                          [&frame_times](TimePoint start, Duration duration, std::size_t samples) {
+                              return frame_times.get(start, duration, samples)
+                                  .back()
+                                  .time_since_epoch()
+                                  .count();
+                          });
+
+        std::cout << "speedup:    " << per_sample / shared << '\n';
+    }
+    catch (nitro::options::parsing_error& e)
+    {
+        std::cerr << e.what() << '\n';
+
+        parser.usage();
+
+        return 1;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+
+    return 0;
+}
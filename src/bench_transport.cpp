@@ -0,0 +1,152 @@
+// Streams gapless frames from lmg-standin (or a real device) over the asio or the io_uring
+// transport and reports the CPU time spent per MB received.
+//
+//   lmg-standin --flood &
+//   bench-transport --transport asio
+//   bench-transport --transport io_uring
+
+#include <lmgd/network/network_socket.hpp>
+#ifdef LMGD_HAVE_IO_URING
+#include <lmgd/network/uring_socket.hpp>
+#endif
+
+#include <nitro/options/parser.hpp>
+
+#include <asio/io_service.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+extern "C"
+{
+#include <sys/resource.h>
+}
+
+using namespace lmgd::network;
+
+namespace
+{
+std::chrono::microseconds cpu_time()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    auto to_us = [](const timeval& tv) {
+        return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec);
+    };
+
+    return to_us(usage.ru_utime) + to_us(usage.ru_stime);
+}
+
+template <typename Socket>
+void run(asio::io_service& io_service, Socket& socket, int tracks, std::uint64_t megabytes)
+{
+    std::string action = "ACTN;TSCYCL?;DURCYCL?";
+    for (int i = 0; i < tracks; i++)
+    {
+        action += "; GLPVAL? " + std::to_string(i);
+    }
+
+    socket << action + '\n';
+    socket << std::string(":FORM:DATA 1\n");
+    socket << std::string(":INIT:CONT ON\n");
+
+    std::uint64_t bytes = 0;
+    std::uint64_t frames = 0;
+    auto limit = megabytes * 1024 * 1024;
+
+    auto wall_start = std::chrono::steady_clock::now();
+    auto cpu_start = cpu_time();
+
+    socket.read_binary_async([&](std::shared_ptr<BinaryData>& data) {
+        bytes += data->size();
+        ++frames;
+
+        return bytes < limit ? CallbackResult::repeat : CallbackResult::cancel;
+    });
+
+    io_service.run();
+
+    auto cpu = cpu_time() - cpu_start;
+    auto wall = std::chrono::steady_clock::now() - wall_start;
+
+    socket << std::string(":INIT:CONT OFF\n");
+
+    auto mb = static_cast<double>(bytes) / (1024 * 1024);
+    auto cpu_ms = std::chrono::duration<double, std::milli>(cpu).count();
+    auto wall_s = std::chrono::duration<double>(wall).count();
+
+    std::cout << "frames:        " << frames << '\n'
+              << "received:      " << mb << " MB\n"
+              << "throughput:    " << mb / wall_s << " MB/s\n"
+              << "CPU time:      " << cpu_ms << " ms\n"
+              << "CPU time / MB: " << cpu_ms / mb << " ms\n";
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    nitro::options::parser parser("bench-transport");
+
+    parser.option("address", "The address of the device or stand-in").default_value("localhost");
+    parser.option("port", "The data port").default_value("5025").short_name("p");
+    parser.option("transport", "Either asio or io_uring").default_value("asio").short_name("t");
+    parser.option("tracks", "Number of tracks per frame").default_value("8");
+    parser.option("megabytes", "Stop after receiving this much data").default_value("1024");
+    parser.toggle("help").short_name("h");
+
+    try
+    {
+        auto options = parser.parse(argc, argv);
+
+        if (options.given("help"))
+        {
+            parser.usage();
+            return 0;
+        }
+
+        auto address = options.get("address");
+        auto port = std::stoi(options.get("port"));
+        auto tracks = std::stoi(options.get("tracks"));
+        auto megabytes = std::stoull(options.get("megabytes"));
+
+        asio::io_service io_service;
+
+        if (options.get("transport") == "asio")
+        {
+            NetworkSocket socket(io_service, address, port);
+            run(io_service, socket, tracks, megabytes);
+        }
+        else if (options.get("transport") == "io_uring")
+        {
+#ifdef LMGD_HAVE_IO_URING
+            UringSocket socket(io_service, address, port);
+            run(io_service, socket, tracks, megabytes);
+#else
+            throw std::runtime_error("built without io_uring support");
+#endif
+        }
+        else
+        {
+            throw std::runtime_error("unknown transport: " + options.get("transport"));
+        }
+    }
+    catch (nitro::options::parsing_error& e)
+    {
+        std::cerr << e.what() << '\n';
+
+        parser.usage();
+
+        return 1;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+
+    return 0;
+}
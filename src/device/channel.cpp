@@ -30,129 +30,130 @@ ChannelSignalCoupling Channel::parse_coupling(const nlohmann::json& json_config)
         json_config["name"].get<std::string>());
 }
 
-Channel::MetricSetType Channel::parse_metrics(const nlohmann::json& config, MeasurementMode mode)
+std::pair<MetricType, MetricBandwidth> Channel::parse_metric(
+    const std::string& metric_string,
+    MeasurementMode mode,
+    const std::string& channel)
 {
-    if (config["metrics"].size() == 0)
-    {
-        Log::info() << "No metrics given for channel: " << config["name"].get<std::string>();
-    }
+    std::stringstream str;
+    str << metric_string;
 
-    Channel::MetricSetType metrics;
+    std::string metric;
+    std::getline(str, metric, '@');
 
-    for (auto& metric_config : config["metrics"])
-    {
-        auto metric_string = metric_config.get<std::string>();
-
-        std::stringstream str;
-        str << metric_string;
+    MetricType metric_type;
 
-        std::string metric;
-        std::getline(str, metric, '@');
-
-        MetricType metric_type;
+    if (metric == "voltage")
+    {
+        metric_type = MetricType::voltage;
+    }
+    else if (metric == "voltage_min")
+    {
+        metric_type = MetricType::voltage_min;
+    }
+    else if (metric == "voltage_max")
+    {
+        metric_type = MetricType::voltage_max;
+    }
+    else if (metric == "voltage_crest")
+    {
+        metric_type = MetricType::voltage_crest;
+    }
+    else if (metric == "current")
+    {
+        metric_type = MetricType::current;
+    }
+    else if (metric == "current_min")
+    {
+        metric_type = MetricType::current_min;
+    }
+    else if (metric == "current_max")
+    {
+        metric_type = MetricType::current_max;
+    }
+    else if (metric == "current_crest")
+    {
+        metric_type = MetricType::current_crest;
+    }
+    else if (metric == "power" || metric == "active_power")
+    {
+        metric_type = MetricType::power;
+    }
+    else if (metric == "apparent" || metric == "apparent_power")
+    {
+        metric_type = MetricType::apparent_power;
+    }
+    else if (metric == "reactive" || metric == "reactive_power")
+    {
+        metric_type = MetricType::reactive_power;
+    }
+    else if (metric == "phase" || metric == "phi")
+    {
+        metric_type = MetricType::phi;
+    }
+    else
+    {
+        raise("Got unknown metric type '", metric_string, "' for channel ", channel);
+    }
 
-        if (metric == "voltage")
-        {
-            metric_type = MetricType::voltage;
-        }
-        else if (metric == "voltage_min")
-        {
-            metric_type = MetricType::voltage_min;
-        }
-        else if (metric == "voltage_max")
-        {
-            metric_type = MetricType::voltage_max;
-        }
-        else if (metric == "voltage_crest")
-        {
-            metric_type = MetricType::voltage_crest;
-        }
-        else if (metric == "current")
-        {
-            metric_type = MetricType::current;
-        }
-        else if (metric == "current_min")
-        {
-            metric_type = MetricType::current_min;
-        }
-        else if (metric == "current_max")
-        {
-            metric_type = MetricType::current_max;
-        }
-        else if (metric == "current_crest")
-        {
-            metric_type = MetricType::current_crest;
-        }
-        else if (metric == "power" || metric == "active_power")
-        {
-            metric_type = MetricType::power;
-        }
-        else if (metric == "apparent" || metric == "apparent_power")
-        {
-            metric_type = MetricType::apparent_power;
-        }
-        else if (metric == "reactive" || metric == "reactive_power")
-        {
-            metric_type = MetricType::reactive_power;
-        }
-        else if (metric == "phase" || metric == "phi")
-        {
-            metric_type = MetricType::phi;
-        }
-        else
+    // Gapless mode can only record power, current, and voltage
+    if (mode == MeasurementMode::gapless)
+    {
+        if (metric_type != MetricType::voltage && metric_type != MetricType::current &&
+            metric_type != MetricType::power)
         {
             raise(
-                "Got unknown metric type '",
+                "The metric '",
                 metric_string,
-                "' for channel ",
-                config["name"].get<std::string>());
+                "' cannot be recorded in gapless mode for channel ",
+                channel);
         }
+    }
 
-        // Gapless mode can only record power, current, and voltage
-        if (mode == MeasurementMode::gapless)
-        {
-            if (metric_type != MetricType::voltage && metric_type != MetricType::current &&
-                metric_type != MetricType::power)
-            {
-                raise(
-                    "The metric '",
-                    metric_string,
-                    "' cannot be recorded in gapless mode for channel ",
-                    config["name"].get<std::string>());
-            }
-        }
+    std::string bandwidth;
+    std::getline(str, bandwidth);
+
+    MetricBandwidth metric_bandwidth;
 
-        std::string bandwidth;
-        std::getline(str, bandwidth);
+    if (mode == MeasurementMode::cycle)
+    {
+        metric_bandwidth = MetricBandwidth::cycle;
+    }
+    else if (bandwidth == "")
+    {
+        metric_bandwidth = MetricBandwidth::wide;
+    }
+    else if (bandwidth == "narrow")
+    {
+        metric_bandwidth = MetricBandwidth::narrow;
+    }
+    else if (bandwidth == "wide")
+    {
+        metric_bandwidth = MetricBandwidth::wide;
+    }
+    else
+    {
+        raise("Got unknown bandwidth '", metric_string, "' for channel ", channel);
+    }
 
-        MetricBandwidth metric_bandwidth;
+    return { metric_type, metric_bandwidth };
+}
 
-        if (mode == MeasurementMode::cycle)
-        {
-            metric_bandwidth = MetricBandwidth::cycle;
-        }
-        else if (bandwidth == "")
-        {
-            metric_bandwidth = MetricBandwidth::wide;
-        }
-        else if (bandwidth == "narrow")
-        {
-            metric_bandwidth = MetricBandwidth::narrow;
-        }
-        else if (bandwidth == "wide")
-        {
-            metric_bandwidth = MetricBandwidth::wide;
-        }
-        else
-        {
-            raise(
-                "Got unknown bandwidth '",
-                metric_string,
-                "' for channel ",
-                config["name"].get<std::string>());
-        }
+Channel::MetricSetType Channel::parse_metrics(const nlohmann::json& config, MeasurementMode mode)
+{
+    if (config["metrics"].size() == 0)
+    {
+        Log::info() << "No metrics given for channel: " << config["name"].get<std::string>();
+    }
+
+    Channel::MetricSetType metrics;
 
-        auto res = metrics.emplace(metric_type, metric_bandwidth);
+    for (auto& metric_config : config["metrics"])
+    {
+        auto metric_string = metric_config.get<std::string>();
+
+        auto res = metrics.insert(
+            parse_metric(metric_string, mode, config["name"].get<std::string>()));
         if (!res.second)
         {
             Log::warn() << "Metric " << metric_string << " has already been added to the channel '"
@@ -171,8 +172,7 @@ Channel::Channel(
     ChannelSignalCoupling coupling,
     float current_range,
     float voltage_range)
-: connection_(*(device.connection_)),
-  id_(id),
+: id_(id),
   name_(name),
   metrics_(metrics),
   coupling_(coupling),
@@ -195,15 +195,14 @@ Channel::Channel(
     // }
     // Log::info() << "Device channel " << id_ << " is a " << channel_type;
 
-    connection_.check_command();
+    // The commands are sent later on together with the rest of the device setup
+    auto& setup = device.setup_commands_;
 
-    connection_.check_command(":SENS:CURR:RANG:AUTO" + std::to_string(id_) + " 0");
-    connection_.check_command(
-        ":SENS:CURR:RANG" + std::to_string(id_) + " " + std::to_string(current_range_));
+    setup.add(":SENS:CURR:RANG:AUTO" + std::to_string(id_) + " 0");
+    setup.add(current_range_command());
 
-    connection_.check_command(":SENS:VOLT:RANG:AUTO" + std::to_string(id_) + " 0");
-    connection_.check_command(
-        ":SENS:VOLT:RANG" + std::to_string(id_) + " " + std::to_string(voltage_range_));
+    setup.add(":SENS:VOLT:RANG:AUTO" + std::to_string(id_) + " 0");
+    setup.add(voltage_range_command());
 
     for (auto metric : metrics_)
     {
@@ -223,11 +222,49 @@ Channel::Channel(device::Device& device, int id, const nlohmann::json& config)
 {
 }
 
+bool Channel::update_ranges(const nlohmann::json& config, network::CommandBatch& commands)
+{
+    auto current_range = config["current_range"].get<float>();
+    auto voltage_range = config["voltage_range"].get<float>();
+    bool changed = false;
+
+    if (current_range != current_range_)
+    {
+        current_range_ = current_range;
+        commands.add(current_range_command());
+        changed = true;
+    }
+
+    if (voltage_range != voltage_range_)
+    {
+        voltage_range_ = voltage_range;
+        commands.add(voltage_range_command());
+        changed = true;
+    }
+
+    return changed;
+}
+
+std::string Channel::current_range_command() const
+{
+    return ":SENS:CURR:RANG" + std::to_string(id_) + " " + std::to_string(current_range_);
+}
+
+std::string Channel::voltage_range_command() const
+{
+    return ":SENS:VOLT:RANG" + std::to_string(id_) + " " + std::to_string(voltage_range_);
+}
+
 const std::string& Channel::name() const
 {
     return name_;
 }
 
+void Channel::name(const std::string& name)
+{
+    name_ = name;
+}
+
 ChannelSignalCoupling Channel::coupling() const
 {
     return coupling_;
@@ -1,6 +1,8 @@
 #include <lmgd/device/device.hpp>
 
+#include <lmgd/device/state_cache.hpp>
 #include <lmgd/network/connection.hpp>
+#include <lmgd/network/gapless_frame.hpp>
 
 #include <lmgd/except.hpp>
 #include <lmgd/log.hpp>
@@ -10,51 +12,162 @@
 #include <date/date.h>
 #include <date/tz.h>
 
+#include <algorithm>
+#include <chrono>
 #include <regex>
 #include <sstream>
 #include <string>
+#include <utility>
 
 #include <cassert>
+#include <cctype>
 #include <cmath>
+#include <cstdlib>
 
-namespace lmgd::device
+extern "C"
 {
+#include <unistd.h>
+}
 
-Device::Device(asio::io_service& io_service, const nlohmann::json& config) : io_service_(io_service)
+namespace lmgd::device
 {
-    if (config.at("measurement").at("device").at("connection").get<std::string>() == "serial")
-    {
-        connection_ = std::make_unique<network::Connection>(
-            io_service_,
-            network::Connection::Type::serial,
-            config.at("measurement").at("device").at("port").get<std::string>());
-    }
-    else if (config.at("measurement").at("device").at("connection").get<std::string>() == "socket")
+namespace
+{
+    network::SerialSettings serial_settings(const nlohmann::json& config)
     {
-        connection_ = std::make_unique<network::Connection>(
-            io_service_,
-            network::Connection::Type::socket,
-            config.at("measurement").at("device").at("address").get<std::string>());
+        network::SerialSettings settings;
+
+        settings.baud_rate = config.value("baud_rate", settings.baud_rate);
+        settings.min_bytes = config.value("vmin", settings.min_bytes);
+        settings.timeout = config.value("vtime", settings.timeout);
+        settings.low_latency = config.value("low_latency", settings.low_latency);
+        settings.negotiate_baud_rates =
+            config.value("negotiate_baud_rates", settings.negotiate_baud_rates);
+        settings.baud_rate_command = config.value("baud_rate_command", settings.baud_rate_command);
+
+        auto flow_control = config.value("flow_control", "none");
+        if (flow_control == "none")
+        {
+            settings.flow_control = network::SerialSettings::FlowControl::none;
+        }
+        else if (flow_control == "software")
+        {
+            settings.flow_control = network::SerialSettings::FlowControl::software;
+        }
+        else if (flow_control == "hardware")
+        {
+            settings.flow_control = network::SerialSettings::FlowControl::hardware;
+        }
+        else
+        {
+            raise("Unknown flow control: ", flow_control);
+        }
+
+        return settings;
     }
-    else
+
+    network::TcpSettings tcp_settings(const nlohmann::json& config)
     {
-        raise("Sorry, I can only connect over network or serial to my LMG device :(");
+        network::TcpSettings settings;
+
+        settings.no_delay = config.value("no_delay", settings.no_delay);
+        settings.receive_buffer = config.value("receive_buffer", settings.receive_buffer);
+        settings.busy_poll = config.value("busy_poll", settings.busy_poll);
+
+        return settings;
     }
 
-    if (config.at("measurement").at("mode").get<std::string>() == "cycle")
+    network::ConnectionSettings connection_settings(const nlohmann::json& config)
     {
-        mode_ = MeasurementMode::cycle;
+        network::ConnectionSettings settings;
+
+        settings.serial = serial_settings(config);
+        settings.tcp = tcp_settings(config.value("tcp", nlohmann::json::object()));
+        // in ms
+        settings.timeout =
+            std::chrono::milliseconds(config.value("timeout", settings.timeout.count()));
+        settings.warm_attach = config.value("warm_attach", settings.warm_attach);
+
+        return settings;
     }
-    else if (config.at("measurement").at("mode").get<std::string>() == "gapless")
+
+    // The type of the connection and the address of the device
+    std::pair<network::Connection::Type, std::string> endpoint(const nlohmann::json& config)
     {
-        mode_ = MeasurementMode::gapless;
+        auto connection = config.at("connection").get<std::string>();
+
+        if (connection == "serial")
+        {
+            return { network::Connection::Type::serial, config.at("port").get<std::string>() };
+        }
+        else if (connection == "socket")
+        {
+            auto type = network::Connection::Type::socket;
+
+            // The io_uring transport is optional, as it needs liburing and a recent kernel
+            auto transport = config.value("transport", "asio");
+            if (transport == "io_uring")
+            {
+#ifdef LMGD_HAVE_IO_URING
+                type = network::Connection::Type::uring_socket;
+#else
+                raise("This build of lmgd has no support for the io_uring transport");
+#endif
+            }
+            else if (transport != "asio")
+            {
+                raise("Unknown transport: ", transport);
+            }
+
+            return { type, config.at("address").get<std::string>() };
+        }
+        else if (connection == "unix")
+        {
+            return { network::Connection::Type::unix_socket, config.at("path").get<std::string>() };
+        }
+
+        raise("Sorry, I can only connect over network, serial or unix sockets to my LMG device :(");
     }
-    else
+
+    // Compares an answer of the device with the argument of a setup command, numbers by value, as
+    // the device formats them on its own, e.g., 1.200000 vs. 1.2
+    bool same_value(std::string answer, std::string expected)
     {
-        raise(
-            "Requested unknown measurement mode: " +
-            config.at("measurement").at("mode").get<std::string>());
+        auto strip = [](std::string& str) {
+            str.erase(std::remove_if(str.begin(), str.end(),
+                                     [](char c) { return c == '"' || std::isspace(c); }),
+                      str.end());
+        };
+        strip(answer);
+        strip(expected);
+
+        char* answer_end;
+        char* expected_end;
+        auto answer_value = std::strtod(answer.c_str(), &answer_end);
+        auto expected_value = std::strtod(expected.c_str(), &expected_end);
+
+        if (!answer.empty() && !expected.empty() && *answer_end == '\0' && *expected_end == '\0')
+        {
+            return std::abs(answer_value - expected_value) <=
+                   1e-6 * std::max(1., std::abs(expected_value));
+        }
+
+        return std::equal(answer.begin(), answer.end(), expected.begin(), expected.end(),
+                          [](char a, char b) { return std::toupper(a) == std::toupper(b); });
     }
+} // namespace
+
+Device::Device(asio::io_service& io_service, const nlohmann::json& config)
+{
+    // Everything that only depends on the config first, so config errors show up, before the
+    // device is reset
+    read_format(config);
+    add_setup_commands(config);
+
+    const auto& device_config = config.at("measurement").at("device");
+    auto [type, address] = endpoint(device_config);
+    connection_ = std::make_unique<network::Connection>(
+        io_service, type, address, connection_settings(device_config));
 
     connection_->send_command(":SYST:ERR:ALL?");
     Log::debug() << "Error log before:" << connection_->read_ascii();
@@ -82,6 +195,148 @@ Device::Device(asio::io_service& io_service, const nlohmann::json& config) : io_
                     << ", (new) " << new_device_time;
     }
 
+    // All the channel and track setup in a few round trips
+    configure(config);
+
+    if (mode_ == MeasurementMode::gapless)
+    {
+        // read lenght of one gapless data block
+        connection_->send_command(":FETC:SCOP:GAPL:TLEN?");
+        gap_length_ = std::stoi(connection_->read_ascii());
+
+        // read actual sampling rate, might differ from the requested one in the config
+        // In contrast to the documentation, using the shorter but equal command
+        // ":FETC:SCOP:GAPL:SRAT?" yields a totally different result. LUL WUT ¯\_(ツ)_/¯
+        connection_->send_command(":FETC:SCOP:GAPL:SRATE?");
+        sampling_rate_ = std::stof(connection_->read_ascii());
+
+        Log::debug() << "gap_length: " << gap_length_ << ", sampling_rate: " << sampling_rate_;
+
+        // TODO fix this SHORT syntax command
+        // We need SHORT syntax for this command, because TSCYCL and DURCYCL aren't documented and
+        // I simply don't know the equivalent SCPI command. FeelsBadMan
+        connection_->send_command("*zlang short");
+        connection_->send_command(action_command());
+        connection_->send_command("*zlang scpi");
+
+        // Finally, let's check the error log if anything went wrong
+        connection_->check_command();
+    }
+    else
+    {
+        connection_->send_command(":SENS:SWE:TIME?");
+        auto sampling_interval = std::stof(connection_->read_ascii());
+        sampling_rate_ = std::round(1. / sampling_interval);
+        Log::debug() << "Sampling rate: " << sampling_rate_;
+    }
+}
+
+Device::Device(asio::io_service& io_service, const nlohmann::json& config, Handover handover)
+{
+    try
+    {
+        read_format(config);
+
+        if (format_ != network::Connection::Mode::binary)
+        {
+            raise("Only recordings in the binary data format can be taken over");
+        }
+
+        // The same commands as the other process, nothing of it is sent to the device
+        add_setup_commands(config);
+
+        const auto& state = handover.state;
+        if (state.at("setup").get<std::vector<std::string>>() != setup())
+        {
+            raise("The recording to take over was set up differently");
+        }
+
+        identification_ = state.at("identification").get<std::string>();
+        unsupported_ = state.at("unsupported").get<std::vector<std::string>>();
+        sampling_rate_ = state.at("sampling_rate").get<double>();
+        if (mode_ == MeasurementMode::gapless)
+        {
+            gap_length_ = state.at("gap_length").get<int64_t>();
+        }
+    }
+    catch (...)
+    {
+        // Otherwise, the connection would stay open, blocking the device for a fresh setup
+        ::close(handover.connection.fd);
+        throw;
+    }
+
+    const auto& device_config = config.at("measurement").at("device");
+    if (device_config.value("warm_attach", false))
+    {
+        serial_ = device_config.at("serial").get<std::string>();
+        state_cache_ = device_config.value("state_cache", StateCache::default_path);
+    }
+
+    auto [type, address] = endpoint(device_config);
+    connection_ = std::make_unique<network::Connection>(io_service, type, address,
+                                                        connection_settings(device_config),
+                                                        std::move(handover.connection));
+
+    Log::info() << "Took over the recording of the device: " << identification_;
+    recording_ = true;
+}
+
+Device::Device(const nlohmann::json& config)
+{
+    read_format(config);
+    add_setup_commands(config);
+
+    // Only to find errors, the connection isn't opened
+    const auto& device_config = config.at("measurement").at("device");
+    endpoint(device_config);
+    connection_settings(device_config);
+    device_config.at("serial").get<std::string>();
+
+    // Until the device tells us otherwise
+    sampling_rate_ = config.at("measurement").at("sampling_rate").get<int>();
+    gap_length_ = 0;
+}
+
+void Device::read_format(const nlohmann::json& config)
+{
+    if (config.at("measurement").at("mode").get<std::string>() == "cycle")
+    {
+        mode_ = MeasurementMode::cycle;
+    }
+    else if (config.at("measurement").at("mode").get<std::string>() == "gapless")
+    {
+        mode_ = MeasurementMode::gapless;
+    }
+    else
+    {
+        raise(
+            "Requested unknown measurement mode: " +
+            config.at("measurement").at("mode").get<std::string>());
+    }
+
+    auto format = config.at("measurement").at("device").value("format", "binary");
+    if (format == "binary")
+    {
+        format_ = network::Connection::Mode::binary;
+    }
+    else if (format == "ascii")
+    {
+        // In gapless mode, the values come as huge lists, which we only support in binary.
+        if (mode_ == MeasurementMode::gapless)
+        {
+            raise("The ascii data format is only supported in cycle mode.");
+        }
+        format_ = network::Connection::Mode::ascii;
+    }
+    else
+    {
+        raise("Requested unknown data format: ", format);
+    }
+}
+
+void Device::add_setup_commands(const nlohmann::json& config)
+{
     // read number of available channels on device from config
     std::size_t num_channels = config.at("measurement").at("device").at("num_channels");
     Log::info() << "Number of available device channels: " << num_channels;
@@ -118,78 +373,34 @@ Device::Device(asio::io_service& io_service, const nlohmann::json& config) : io_
     // group. Therefore, only the newer LMG670 can support mixed coupling setups. However, this is
     // not supported right now. We only set the coupling here once to whatever the first channel has
     // as coupling according to the config
-    connection_->check_command(
+    setup_commands_.add(
         ":INP:COUP " + std::to_string(static_cast<int>(channels_.front().coupling())));
 
-    {
-        // These commands are only available on the newer 670 device, we send them to the older
-        // devices to, but we will ignore any errors.
-
-        // First, check for any errors, so they don't get lost
-        connection_->check_command();
+    // These commands are only available on the newer 670 device, we send them to the older
+    // devices to, but we will ignore any errors.
 
-        // set grouping to only one group comprising all channels
-        connection_->send_command(":SENS:GRO:LIST " + std::to_string(num_channels));
+    // set grouping to only one group comprising all channels
+    setup_commands_.add_optional(":SENS:GRO:LIST " + std::to_string(num_channels));
 
-        // enable DualPath mode, so we can record metrics narrow and wide at the same time
-        connection_->send_command(":SENS:FILT:PROC 1");
-
-        // ignore any errors
-        connection_->send_command(":SYST:ERR:ALL?");
-        (void)connection_->read_ascii();
-    }
+    // enable DualPath mode, so we can record metrics narrow and wide at the same time
+    setup_commands_.add_optional(":SENS:FILT:PROC 1");
 
     // disable zero supression
-    connection_->check_command(":SENS:ZPR 0");
+    setup_commands_.add(":SENS:ZPR 0");
 
     if (mode_ == MeasurementMode::gapless)
     {
         // set sampling rate
-        connection_->check_command(
+        setup_commands_.add(
             ":SENS:GAPL:SRAT " +
             std::to_string(config.at("measurement").at("sampling_rate").get<int>()));
 
         // activate scope mode, in scope mode we can read the gapless values
-        connection_->check_command(":SENS:SWE:MOD SCOPE");
+        setup_commands_.add(":SENS:SWE:MOD SCOPE");
 
         // Technically, this triggers the next measurement cycle.
         // But no one knows, why and if we need it, but it is part of the example ¯\_(ツ)_/¯
-        connection_->check_command(":INIT:IMM");
-
-        // read lenght of one gapless data block
-        connection_->send_command(":FETC:SCOP:GAPL:TLEN?");
-        gap_length_ = std::stoi(connection_->read_ascii());
-
-        // read actual sampling rate, might differ from the requested one in the config
-        // In contrast to the documentation, using the shorter but equal command
-        // ":FETC:SCOP:GAPL:SRAT?" yields a totally different result. LUL WUT ¯\_(ツ)_/¯
-        connection_->send_command(":FETC:SCOP:GAPL:SRATE?");
-        sampling_rate_ = std::stof(connection_->read_ascii());
-
-        Log::debug() << "gap_length: " << gap_length_ << ", sampling_rate: " << sampling_rate_;
-
-        // build action command, which gets execute during the following CONT ON
-        // Immortal quote: "Die Dokumentation wird noch angepasst"
-        // TSCYCL is the timestamp of the cycle
-        // DURCYCL I have no fucking idea. Good luck with that.
-        std::string action = "ACTN;TSCYCL?;DURCYCL?";
-
-        // each channel only has the one track -> power
-        for (auto i = 0u; i < tracks_.size(); i++)
-        {
-            action +=
-                "; GLPVAL? " + std::to_string(i) + ", (0:" + std::to_string(gap_length_ - 1) + ")";
-        }
-
-        // TODO fix this SHORT syntax command
-        // We need SHORT syntax for this command, because TSCYCL and DURCYCL aren't documented and
-        // I simply don't know the equivalent SCPI command. FeelsBadMan
-        connection_->send_command("*zlang short");
-        connection_->send_command(action);
-        connection_->send_command("*zlang scpi");
-
-        // Finally, let's check the error log if anything went wrong
-        connection_->check_command();
+        setup_commands_.add(":INIT:IMM");
     }
     else
     {
@@ -202,35 +413,56 @@ Device::Device(asio::io_service& io_service, const nlohmann::json& config) : io_
         std::stringstream str;
         str << sampling_interval;
 
-        connection_->check_command(":SENS:SWE:TIME " + str.str());
-        connection_->send_command(":SENS:SWE:TIME?");
-        sampling_interval = std::stof(connection_->read_ascii());
-        sampling_rate_ = std::round(1. / sampling_interval);
-        Log::debug() << "Sampling rate: " << sampling_rate_;
+        setup_commands_.add(":SENS:SWE:TIME " + str.str());
+    }
+}
+
+Handover Device::hand_over()
+{
+    Handover handover;
+
+    handover.state["identification"] = identification_;
+    handover.state["setup"] = setup();
+    handover.state["unsupported"] = unsupported_;
+    handover.state["sampling_rate"] = sampling_rate_;
+    if (mode_ == MeasurementMode::gapless)
+    {
+        handover.state["gap_length"] = gap_length_;
     }
-} // namespace lmgd::device
+
+    handover.connection = connection_->release();
+    // The recording goes on without us
+    recording_ = false;
+
+    return handover;
+}
 
 Device::~Device()
 {
     if (recording_)
     {
-        stop_recording();
+        try
+        {
+            stop_recording();
+        }
+        catch (std::exception& e)
+        {
+            Log::warn() << "Failed to stop the recording: " << e.what();
+        }
     }
 }
 
+void Device::abort()
+{
+    recording_ = false;
+    connection_->abort();
+}
+
 void Device::start_recording(lmgd::network::Connection::Mode mode)
 {
     if (mode_ == MeasurementMode::cycle)
     {
-        // build action command, which gets execute during the following CONT ON
-        // Note: There is no timestamp available on the device, so we have to take them ourselves :(
-        std::string action = ":TRIG:ACT;";
-        for (const auto& track : tracks_)
-        {
-            action += track.get_action_command(mode_) + ";";
-        }
-
-        connection_->send_command(action);
+        connection_->send_command(action_command());
         connection_->check_command();
     }
 
@@ -264,10 +496,66 @@ void Device::add_track(const Channel& channel, MetricType type, MetricBandwidth
     tracks_.emplace_back(channel, tracks_.size(), type, bandwidth);
     if (mode_ == MeasurementMode::gapless)
     {
-        connection_->check_command(tracks_.back().get_action_command(mode_));
+        setup_commands_.add(tracks_.back().get_action_command(mode_));
     }
 }
 
+std::string Device::action_command() const
+{
+    if (mode_ == MeasurementMode::gapless)
+    {
+        // Immortal quote: "Die Dokumentation wird noch angepasst"
+        // TSCYCL is the timestamp of the cycle
+        // DURCYCL I have no fucking idea. Good luck with that.
+        std::string action = "ACTN;TSCYCL?;DURCYCL?";
+
+        // each channel only has the one track -> power
+        for (auto i = 0u; i < tracks_.size(); i++)
+        {
+            action +=
+                "; GLPVAL? " + std::to_string(i) + ", (0:" + std::to_string(gap_length_ - 1) + ")";
+        }
+
+        return action;
+    }
+
+    // Note: There is no timestamp available on the device, so we have to take them ourselves :(
+    std::string action = ":TRIG:ACT;";
+    for (const auto& track : tracks_)
+    {
+        action += track.get_action_command(mode_) + ";";
+    }
+    return action;
+}
+
+std::size_t Device::frame_size() const
+{
+    if (mode_ == MeasurementMode::gapless)
+    {
+        // timestamp and duration of the cycle, followed by one list per track, which is prefixed
+        // with its length
+        return 2 * sizeof(int64_t) +
+               tracks_.size() * (sizeof(int64_t) + gap_length_ * sizeof(float));
+    }
+
+    return tracks_.size() * sizeof(float);
+}
+
+bool Device::check_frame(const network::BinaryData& data) const
+{
+    if (mode_ == MeasurementMode::cycle)
+    {
+        return data.size() >= frame_size();
+    }
+
+    return network::GaplessFrame::check(data, tracks_.size(), gap_length_);
+}
+
+const network::ResyncStats& Device::resync_stats() const
+{
+    return connection_->resync_stats();
+}
+
 const std::vector<Track>& Device::get_tracks() const
 {
     return tracks_;
@@ -277,7 +565,7 @@ void Device::fetch_binary_data(network::BinaryCallback cb)
 {
     Log::debug() << "Device::fetch_binary_data";
 
-    connection_->read_binary_async(cb);
+    connection_->read_binary_async(cb, frame_size());
 }
 
 void Device::fetch_data(network::Callback cb)
@@ -287,10 +575,203 @@ void Device::fetch_data(network::Callback cb)
     connection_->read_async(cb);
 }
 
+void Device::configure(const nlohmann::json& config)
+{
+    const auto& device_config = config.at("measurement").at("device");
+
+    if (!device_config.value("warm_attach", false))
+    {
+        connection_->execute(setup_commands_);
+        return;
+    }
+
+    serial_ = device_config.at("serial").get<std::string>();
+    state_cache_ = device_config.value("state_cache", StateCache::default_path);
+
+    if (connection_->attached())
+    {
+        StateCache cache(state_cache_);
+        auto entry = cache.get(serial_);
+        if (entry && entry->identification == identification_ && entry->setup == setup() &&
+            check_live_state(entry->unsupported))
+        {
+            Log::info() << "Device is still set up, skipping the configuration";
+            unsupported_ = entry->unsupported;
+            return;
+        }
+
+        Log::info() << "Device isn't set up as configured, resetting it";
+        // In case we don't get through the setup
+        cache.erase(serial_);
+        connection_->send_command("*rst");
+    }
+
+    unsupported_ = connection_->execute(setup_commands_);
+    remember_setup();
+}
+
+std::vector<std::string> Device::setup() const
+{
+    std::vector<std::string> result;
+    for (const auto& command : setup_commands_.commands())
+    {
+        result.push_back(command.text);
+    }
+    return result;
+}
+
+void Device::remember_setup()
+{
+    if (!state_cache_.empty())
+    {
+        StateCache(state_cache_).put(serial_, { identification_, setup(), unsupported_ });
+    }
+}
+
+void Device::rename_channels(const nlohmann::json& config)
+{
+    for (auto& channel : channels_)
+    {
+        channel.name(config.at("channels").at(channel.id() - 1).at("name").get<std::string>());
+    }
+}
+
+void Device::reset_stream()
+{
+    // The stream might have ended without us stopping it
+    recording_ = false;
+
+    connection_->stop_reading();
+}
+
+void Device::update_ranges(const nlohmann::json& config)
+{
+    reset_stream();
+
+    network::CommandBatch commands;
+    for (auto& channel : channels_)
+    {
+        channel.update_ranges(config.at("channels").at(channel.id() - 1), commands);
+    }
+
+    if (commands.empty())
+    {
+        return;
+    }
+
+    Log::info() << "Changing the ranges of the device";
+    connection_->execute(commands);
+
+    // Keep the setup up to date for the next warm attach
+    for (const auto& command : commands.commands())
+    {
+        setup_commands_.update(command.text);
+    }
+    remember_setup();
+}
+
+bool Device::check_live_state(const std::vector<std::string>& unsupported)
+{
+    // Turn each setup command into the matching query, e.g., ":SENS:CURR:RANG1 1.2" into
+    // ":SENS:CURR:RANG1?", or ":SENS:GAPL:TRAC 0, \"P1111\"" into ":SENS:GAPL:TRAC? 0".
+    std::vector<std::string> queries;
+    std::vector<std::string> expected;
+
+    for (const auto& command : setup_commands_.commands())
+    {
+        if (std::find(unsupported.begin(), unsupported.end(), command.text) != unsupported.end())
+        {
+            continue;
+        }
+
+        auto space = command.text.find(' ');
+        if (space == std::string::npos)
+        {
+            // e.g. :INIT:IMM, which doesn't set anything
+            continue;
+        }
+
+        auto header = command.text.substr(0, space);
+        auto arguments = command.text.substr(space + 1);
+        auto comma = arguments.find(',');
+
+        if (comma == std::string::npos)
+        {
+            queries.push_back(header + "?");
+            expected.push_back(arguments);
+        }
+        else
+        {
+            queries.push_back(header + "? " + arguments.substr(0, comma));
+            expected.push_back(arguments.substr(comma + 1));
+        }
+    }
+
+    // Same as the setup, ask for as many values in one line as possible. The answers come back in
+    // one line, separated by ';'.
+    std::vector<std::string> answers;
+    std::string line;
+
+    auto query = [this, &line, &answers]() {
+        connection_->send_command(line);
+        std::stringstream answer(connection_->read_ascii());
+        for (std::string value; std::getline(answer, value, ';');)
+        {
+            answers.push_back(value);
+        }
+        line.clear();
+    };
+
+    const auto max_line_length = network::CommandBatch::default_max_line_length;
+
+    for (const auto& q : queries)
+    {
+        if (!line.empty() && line.size() + q.size() + 1 > max_line_length)
+        {
+            query();
+        }
+        line += (line.empty() ? "" : ";") + q;
+    }
+    if (!line.empty())
+    {
+        query();
+    }
+
+    try
+    {
+        connection_->check_command();
+    }
+    catch (std::exception& e)
+    {
+        Log::debug() << "Querying the device state failed: " << e.what();
+        return false;
+    }
+
+    if (answers.size() != expected.size())
+    {
+        Log::debug() << "Got " << answers.size() << " answers for " << expected.size()
+                     << " queries of the device state";
+        return false;
+    }
+
+    for (std::size_t i = 0; i < answers.size(); i++)
+    {
+        if (!same_value(answers[i], expected[i]))
+        {
+            Log::debug() << "Device state differs: " << queries[i] << " is " << answers[i]
+                         << " instead of " << expected[i];
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void Device::check_serial_number(const nlohmann::json& config)
 {
     connection_->send_command("*idn?");
     auto idn = connection_->read_ascii();
+    identification_ = idn;
 
     std::regex reg("^([^,]+),([^,]+),([^,]+),([^,]+)$");
     std::smatch match;
@@ -0,0 +1,210 @@
+#include <lmgd/device/state_cache.hpp>
+
+#include <lmgd/log.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace lmgd::device
+{
+namespace
+{
+    // Holds an exclusive flock() on the file at path as long as it lives
+    class FileLock
+    {
+    public:
+        explicit FileLock(const std::string& path)
+        {
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+            if (fd_ < 0)
+            {
+                Log::warn() << "Failed to open " << path << ": " << std::strerror(errno);
+                return;
+            }
+
+            int result;
+            do
+            {
+                result = ::flock(fd_, LOCK_EX);
+            } while (result < 0 && errno == EINTR);
+
+            if (result < 0)
+            {
+                Log::warn() << "Failed to lock " << path << ": " << std::strerror(errno);
+                ::close(fd_);
+                fd_ = -1;
+            }
+        }
+
+        ~FileLock()
+        {
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+            }
+        }
+
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+        explicit operator bool() const
+        {
+            return fd_ >= 0;
+        }
+
+    private:
+        int fd_ = -1;
+    };
+
+    bool write_all(int fd, const std::string& data)
+    {
+        std::size_t written = 0;
+        while (written < data.size())
+        {
+            auto result = ::write(fd, data.data() + written, data.size() - written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            written += result;
+        }
+        return true;
+    }
+} // namespace
+
+StateCache::StateCache(std::string path) : path_(std::move(path)), data_(nlohmann::json::object())
+{
+    load();
+}
+
+void StateCache::load()
+{
+    data_ = nlohmann::json::object();
+
+    std::ifstream file(path_);
+    if (!file)
+    {
+        Log::debug() << "No device state cache at " << path_;
+        return;
+    }
+
+    try
+    {
+        file >> data_;
+    }
+    catch (std::exception& e)
+    {
+        Log::warn() << "Ignoring broken device state cache " << path_ << ": " << e.what();
+        data_ = nlohmann::json::object();
+    }
+}
+
+std::optional<StateCache::Entry> StateCache::get(const std::string& serial) const
+{
+    auto it = data_.find(serial);
+    if (it == data_.end())
+    {
+        return std::nullopt;
+    }
+
+    try
+    {
+        return Entry{ it->at("identification").get<std::string>(),
+                      it->at("setup").get<std::vector<std::string>>(),
+                      it->at("unsupported").get<std::vector<std::string>>() };
+    }
+    catch (std::exception& e)
+    {
+        Log::warn() << "Ignoring broken device state cache entry for " << serial << ": "
+                    << e.what();
+        return std::nullopt;
+    }
+}
+
+void StateCache::put(const std::string& serial, const Entry& entry)
+{
+    modify([&serial, &entry](auto& data) {
+        data[serial] = { { "identification", entry.identification },
+                         { "setup", entry.setup },
+                         { "unsupported", entry.unsupported } };
+        return true;
+    });
+}
+
+void StateCache::erase(const std::string& serial)
+{
+    modify([&serial](auto& data) { return data.erase(serial) > 0; });
+}
+
+void StateCache::modify(const std::function<bool(nlohmann::json&)>& change)
+{
+    auto slash = path_.rfind('/');
+    if (slash != std::string::npos && slash > 0)
+    {
+        auto directory = path_.substr(0, slash);
+        if (::mkdir(directory.c_str(), 0700) < 0 && errno != EEXIST)
+        {
+            Log::warn() << "Failed to create the directory of the device state cache " << directory
+                        << ": " << std::strerror(errno);
+            return;
+        }
+    }
+
+    FileLock lock(path_ + ".lock");
+    if (!lock)
+    {
+        return;
+    }
+
+    // Another device may have changed its entry since we read the file
+    load();
+    if (change(data_))
+    {
+        save();
+    }
+}
+
+void StateCache::save() const
+{
+    // Write a new file and replace the old one, so a crash never leaves half a file behind. The
+    // new file is created exclusively, so it can't be a link planted by someone else.
+    std::string tmp_path = path_ + ".XXXXXX";
+    int fd = ::mkstemp(tmp_path.data());
+    if (fd < 0)
+    {
+        Log::warn() << "Failed to create device state cache " << tmp_path << ": "
+                    << std::strerror(errno);
+        return;
+    }
+
+    bool written = write_all(fd, data_.dump(4) + '\n');
+    if (::close(fd) < 0 || !written)
+    {
+        Log::warn() << "Failed to write device state cache " << tmp_path;
+        ::unlink(tmp_path.c_str());
+        return;
+    }
+
+    if (std::rename(tmp_path.c_str(), path_.c_str()) != 0)
+    {
+        Log::warn() << "Failed to replace device state cache " << path_ << ": "
+                    << std::strerror(errno);
+        ::unlink(tmp_path.c_str());
+    }
+}
+} // namespace lmgd::device
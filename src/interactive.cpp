@@ -46,15 +46,37 @@ int main(int argc, char* argv[])
 
         while ((std::cout << "lmg $ ") && std::getline(std::cin, line) && line.size() > 1)
         {
-            socket.send_command(line);
-
+            // Don't hang forever on queries the device doesn't answer
             if (line.back() == '?')
             {
-                std::cout << socket.read_ascii() << std::endl;
+                socket.async_query(line, [](auto ec, auto answer) {
+                    if (ec)
+                    {
+                        std::cerr << "failed: " << ec.message() << '\n';
+                        return;
+                    }
+                    std::cout << answer << std::endl;
+                });
+            }
+            else
+            {
+                socket.async_send_command(line, [](auto ec) {
+                    if (ec)
+                    {
+                        std::cerr << "failed: " << ec.message() << '\n';
+                    }
+                });
             }
 
-            socket.send_command(":SYST:ERR:ALL?");
-            std::cerr << "errors before: " << socket.read_ascii() << '\n';
+            socket.async_query(":SYST:ERR:ALL?", [](auto ec, auto errors) {
+                if (!ec)
+                {
+                    std::cerr << "errors before: " << errors << '\n';
+                }
+            });
+
+            io_serivce.run();
+            io_serivce.restart();
         }
     }
     catch (nitro::options::parsing_error& e)
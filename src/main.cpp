@@ -1,15 +1,56 @@
+#include <lmgd/source/check_config.hpp>
 #include <lmgd/source/source.hpp>
 
 #include <lmgd/log.hpp>
 
 #include <nitro/options/parser.hpp>
-#include <nitro/lang/enumerate.hpp>
 
+#include <nlohmann/json.hpp>
+
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
 using lmgd::Log;
 
+// Checks the config without touching the devices and describes what we would do with them
+int check_config(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Can't open config: " << path << '\n';
+        return 1;
+    }
+
+    try
+    {
+        nlohmann::json config;
+        file >> config;
+
+        auto devices = lmgd::source::check_configs(config);
+        auto configs = lmgd::source::device_configs(config);
+        for (std::size_t i = 0; i < devices.size(); i++)
+        {
+            if (devices.size() > 1)
+            {
+                std::cout << (i > 0 ? "\n" : "") << "Device " << i + 1 << " of " << devices.size()
+                          << ", serial " << configs[i]["measurement"]["device"].value("serial", "")
+                          << ":\n\n";
+            }
+            lmgd::source::describe(*devices[i], std::cout);
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Invalid config: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
 // TODO setup signal handler and clean up properly ...
 
 int main(int argc, char* argv[])
@@ -25,6 +66,9 @@ int main(int argc, char* argv[])
     parser.toggle("debug").short_name("d");
     parser.toggle("trace").short_name("t");
     parser.toggle("drop-data").short_name("x");
+    parser.option("check-config",
+                  "Checks the source config in the given JSON file and describes the setup of the "
+                  "devices, without connecting to anything.");
 
     try
     {
@@ -51,6 +95,11 @@ int main(int argc, char* argv[])
 
         metricq::logger::nitro::initialize();
 
+        if (options.given("check-config"))
+        {
+            return check_config(options.get("check-config"));
+        }
+
         lmgd::source::Source source(
             options.get("server"), options.get("token"), options.given("drop-data"));
 
@@ -0,0 +1,85 @@
+#include <lmgd/network/command_batch.hpp>
+
+#include <lmgd/except.hpp>
+
+#include <utility>
+
+namespace lmgd::network
+{
+CommandBatch& CommandBatch::add(std::string command)
+{
+    if (command.find('?') != std::string::npos)
+    {
+        raise("Queries can't be part of a command batch: ", command);
+    }
+
+    commands_.push_back({ std::move(command), false });
+    return *this;
+}
+
+CommandBatch& CommandBatch::add_optional(std::string command)
+{
+    add(std::move(command));
+    commands_.back().optional = true;
+    return *this;
+}
+
+bool CommandBatch::update(const std::string& command)
+{
+    auto header = command.substr(0, command.find(' '));
+
+    for (auto& entry : commands_)
+    {
+        if (entry.text.compare(0, entry.text.find(' '), header) == 0)
+        {
+            entry.text = command;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<CommandBatch::Line> CommandBatch::lines() const
+{
+    std::vector<Line> result;
+    std::size_t length = 0;
+
+    for (std::size_t i = 0; i < commands_.size(); i++)
+    {
+        const auto& command = commands_[i];
+
+        // The errors of a line can't be told apart, so each optional command gets a line of its
+        // own. A command longer than the limit does as well.
+        if (result.empty() || command.optional || result.back().optional ||
+            length + 1 + command.text.size() > max_line_length_)
+        {
+            result.push_back({ i, i + 1, command.optional });
+            length = command.text.size();
+        }
+        else
+        {
+            result.back().end = i + 1;
+            length += 1 + command.text.size();
+        }
+    }
+
+    return result;
+}
+
+std::string CommandBatch::join(const Line& line) const
+{
+    std::string result;
+
+    for (auto i = line.begin; i < line.end; i++)
+    {
+        if (i != line.begin)
+        {
+            result += ';';
+        }
+        result += commands_[i].text;
+    }
+
+    return result;
+}
+} // namespace lmgd::network
@@ -2,52 +2,213 @@
 
 #include <lmgd/network/network_socket.hpp>
 #include <lmgd/network/serial_socket.hpp>
+#include <lmgd/network/unix_socket.hpp>
+#ifdef LMGD_HAVE_IO_URING
+#include <lmgd/network/uring_socket.hpp>
+#endif
 
 #include <lmgd/except.hpp>
 #include <lmgd/log.hpp>
 
-#include <asio/completion_condition.hpp>
-#include <asio/read.hpp>
-#include <asio/read_until.hpp>
-
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+extern "C"
+{
+#include <unistd.h>
+}
 
 namespace lmgd::network
 {
+namespace
+{
+    const std::string no_error = "0,\"No error\"";
+
+    struct RawSink
+    {
+        std::byte* append(std::size_t size)
+        {
+            auto old_size = data.size();
+            data.resize(old_size + size);
+            return reinterpret_cast<std::byte*>(data.data() + old_size);
+        }
+
+        void clear()
+        {
+            data.clear();
+        }
+
+        std::vector<char> data;
+    };
+
+    // Blocks until one complete frame has been parsed into sink.
+    template <typename Transport, typename Sink>
+    void read_frame(Transport& socket, Sink& sink)
+    {
+        auto& parser = socket.frame_parser();
+
+        while (!parser.parse(sink))
+        {
+            auto buffer = parser.prepare();
+            parser.commit(socket.read_some(static_cast<std::byte*>(buffer.data()), buffer.size()));
+        }
+    }
+} // namespace
+
+template <typename F>
+decltype(auto) Connection::visit(F&& f)
+{
+    return std::visit(
+        [&f](auto& socket) -> decltype(auto) {
+            assert(socket);
+            return f(*socket);
+        },
+        socket_);
+}
+
+template <typename F>
+decltype(auto) Connection::visit(F&& f) const
+{
+    return std::visit(
+        [&f](const auto& socket) -> decltype(auto) {
+            assert(socket);
+            return f(std::as_const(*socket));
+        },
+        socket_);
+}
 
-Connection::Connection(asio::io_service& io_service, Type type, const std::string& hostname)
-: io_service_(io_service), type_(type), hostname_(hostname)
+bool Connection::has_socket() const
 {
+    return std::visit([](const auto& socket) { return static_cast<bool>(socket); }, socket_);
+}
+
+Connection::Connection(
+    asio::io_service& io_service,
+    Type type,
+    const std::string& hostname,
+    const ConnectionSettings& settings)
+: io_service_(io_service),
+  type_(type),
+  hostname_(hostname),
+  settings_(settings),
+  deadline_(io_service)
+{
+    if (settings_.warm_attach && attach())
+    {
+        return;
+    }
+
     if (type_ == Type::serial)
     {
-        socket_ = std::make_unique<lmgd::network::SerialSocket>(io_service_, hostname_);
+        socket_ = std::make_unique<lmgd::network::SerialSocket>(
+            io_service_, hostname_, settings_.serial);
     }
 
     reset();
     start();
 }
 
-Connection::~Connection()
+Connection::Connection(
+    asio::io_service& io_service,
+    Type type,
+    const std::string& hostname,
+    const ConnectionSettings& settings,
+    Released released)
+: io_service_(io_service),
+  type_(type),
+  hostname_(hostname),
+  settings_(settings),
+  mode_(Mode::binary),
+  attached_(true),
+  deadline_(io_service)
 {
-    if (socket_)
+    switch (type_)
     {
-        stop();
+    case Type::socket:
+        socket_ = std::make_unique<lmgd::network::NetworkSocket>(io_service_, released.fd);
+        break;
+    case Type::serial:
+        socket_ = std::make_unique<lmgd::network::SerialSocket>(
+            io_service_, released.fd, settings_.serial);
+        break;
+    case Type::unix_socket:
+        socket_ = std::make_unique<lmgd::network::UnixSocket>(io_service_, released.fd);
+        break;
+    case Type::uring_socket:
+#ifdef LMGD_HAVE_IO_URING
+        socket_ = std::make_unique<lmgd::network::UringSocket>(io_service_, released.fd);
+        break;
+#else
+        ::close(released.fd);
+        raise("This build of lmgd has no support for the io_uring transport");
+#endif
     }
+
+    visit([this, &released](auto& socket) {
+        socket.timeout(settings_.timeout);
+        socket.frame_parser().feed(released.buffered);
+    });
+
+    Log::info() << "Took over the connection to the device with " << released.buffered.size()
+                << " buffered bytes";
 }
 
-void Connection::start()
+Connection::~Connection()
 {
-    if (!socket_)
+    if (has_socket() && !aborted_)
     {
-        if (type_ == Type::socket)
+        try
         {
-            socket_ = std::make_unique<lmgd::network::NetworkSocket>(io_service_, hostname_, 5025);
+            stop();
         }
-        else
+        catch (std::exception& e)
         {
-            socket_ = std::make_unique<lmgd::network::SerialSocket>(io_service_, hostname_);
+            Log::warn() << "Failed to stop the device: " << e.what();
         }
     }
+}
+
+void Connection::open()
+{
+    if (!has_socket())
+    {
+        switch (type_)
+        {
+        case Type::socket:
+            socket_ = std::make_unique<lmgd::network::NetworkSocket>(
+                io_service_, hostname_, 5025, settings_.tcp, settings_.timeout);
+            break;
+        case Type::serial:
+            socket_ = std::make_unique<lmgd::network::SerialSocket>(
+                io_service_, hostname_, settings_.serial);
+            break;
+        case Type::unix_socket:
+            socket_ = std::make_unique<lmgd::network::UnixSocket>(io_service_, hostname_);
+            break;
+        case Type::uring_socket:
+#ifdef LMGD_HAVE_IO_URING
+            socket_ = std::make_unique<lmgd::network::UringSocket>(
+                io_service_, hostname_, 5025, settings_.tcp, settings_.timeout);
+            break;
+#else
+            raise("This build of lmgd has no support for the io_uring transport");
+#endif
+        }
+    }
+
+    visit([this](auto& socket) { socket.timeout(settings_.timeout); });
+
+    if (type_ == Type::serial && !settings_.serial.negotiate_baud_rates.empty())
+    {
+        std::get<std::unique_ptr<lmgd::network::SerialSocket>>(socket_)->negotiate();
+    }
+}
+
+void Connection::start()
+{
+    open();
 
     send_command("*rst");
     send_command("*idn?");
@@ -57,12 +218,88 @@ void Connection::start()
     // send_command("*zlang short");
 }
 
+bool Connection::attach()
+{
+    try
+    {
+        open();
+
+        // A recording might still be running, if we didn't stop cleanly. Its data arrives before
+        // the answer to *opc?, so anything else than a plain "1" means, the stream is out of sync.
+        send_command(":INIT:CONT OFF;:FORM:DATA 0;*opc?");
+        auto answer = read_ascii();
+
+        if (answer == "1")
+        {
+            send_command("*idn?");
+            Log::info() << "Device: " << read_ascii();
+            Log::info() << "Attached to the device without resetting it";
+
+            attached_ = true;
+            return true;
+        }
+
+        Log::info() << "Device is still sending data, resetting it";
+    }
+    catch (TimeoutError& e)
+    {
+        Log::info() << "Device didn't answer, resetting it: " << e.what();
+    }
+
+    // Throw away everything still buffered
+    std::visit([](auto& socket) { socket.reset(); }, socket_);
+    return false;
+}
+
+void Connection::abort()
+{
+    aborted_ = true;
+
+    if (has_socket())
+    {
+        visit([](auto& socket) { socket.cancel(); });
+    }
+}
+
+bool Connection::attached() const
+{
+    return attached_;
+}
+
+Connection::Released Connection::release()
+{
+    assert(mode_ == Mode::binary);
+
+    Released released;
+    visit([&released](auto& socket) {
+        socket.stop_reading();
+        released.buffered = socket.take_buffered();
+        released.fd = ::dup(socket.asio_socket().native_handle());
+    });
+
+    if (released.fd < 0)
+    {
+        raise("Failed to duplicate the connection to the device: ", std::strerror(errno));
+    }
+
+    aborted_ = true;
+    return released;
+}
+
 void Connection::stop()
 {
-    send_command("*rst");
+    // Leave the device configured for the next warm attach
+    if (settings_.warm_attach)
+    {
+        send_command(":FORM:DATA 0");
+    }
+    else
+    {
+        send_command("*rst");
+    }
     send_command("gtl");
 
-    socket_.reset();
+    std::visit([](auto& socket) { socket.reset(); }, socket_);
     mode_ = Mode::ascii;
 }
 
@@ -72,14 +309,20 @@ void Connection::reset()
 
     if (type_ == Type::serial)
     {
-        assert(socket_);
+        auto& socket = std::get<std::unique_ptr<lmgd::network::SerialSocket>>(socket_);
+        assert(socket);
 
-        dynamic_cast<lmgd::network::SerialSocket*>(socket_.get())->asio_socket().send_break();
-        dynamic_cast<lmgd::network::SerialSocket*>(socket_.get())->flush();
+        socket->asio_socket().send_break();
+        socket->flush();
+    }
+    else if (type_ == Type::unix_socket)
+    {
+        Log::debug() << "No interface reset possible on a unix domain socket";
     }
     else
     {
-        lmgd::network::NetworkSocket socket(io_service_, hostname_, 5026);
+        lmgd::network::NetworkSocket socket(
+            io_service_, hostname_, 5026, settings_.tcp, settings_.timeout);
 
         socket << "break\n";
         std::string line = socket.read_line();
@@ -105,7 +348,7 @@ void Connection::mode(Connection::Mode mode)
 void Connection::send_command(const std::string& cmd)
 {
     Log::debug() << "Sending command: " << cmd;
-    *socket_ << cmd + '\n';
+    visit([&cmd](auto& socket) { socket << cmd + '\n'; });
 }
 
 void Connection::check_command(std::string cmd)
@@ -120,100 +363,221 @@ void Connection::check_command(std::string cmd)
 
     auto result = read_ascii();
 
-    if (result != "0,\"No error\"")
+    if (result != no_error)
     {
         raise(result);
     }
 }
 
-BinaryData Connection::read_binary(size_t reserved_size)
+std::vector<std::string> Connection::execute(const CommandBatch& batch)
 {
-    assert(mode_ == Mode::binary);
-
-    char prefix;
-    *socket_ >> prefix;
+    const auto& commands = batch.commands();
+    std::vector<std::string> failed;
 
-    BinaryData data(reserved_size);
-    while (prefix == '#')
+    for (const auto& line : batch.lines())
     {
-        char size_size_buffer;
-        *socket_ >> size_size_buffer;
+        send_command(batch.join(line) + ";:SYST:ERR:ALL?");
+        auto result = read_ascii();
 
-        std::size_t size_size = size_size_buffer - '0';
+        if (result == no_error)
+        {
+            continue;
+        }
 
-        auto size_buffer = std::string(size_size, '$');
+        // Optional commands have a line of their own, so the error is surely theirs
+        if (line.optional)
+        {
+            Log::debug() << "Ignoring error of optional command '" << commands[line.begin].text
+                         << "': " << result;
+            failed.push_back(commands[line.begin].text);
+            continue;
+        }
 
-        socket_->read(reinterpret_cast<std::byte*>(size_buffer.data()), size_size);
+        Log::debug() << "Command batch failed: " << result << ". Replaying commands one by one.";
 
-        auto size = std::stoull(size_buffer);
-        Log::trace() << "Reading binary chunk of size: " << size;
+        for (auto i = line.begin; i < line.end; i++)
+        {
+            send_command(commands[i].text + ";:SYST:ERR:ALL?");
+            auto error = read_ascii();
 
-        socket_->read(data.append(size), size);
+            if (error != no_error)
+            {
+                raise("Command '", commands[i].text, "' failed: ", error);
+            }
+        }
 
-        *socket_ >> prefix;
+        Log::warn() << "Error of command batch didn't reproduce: " << result;
     }
 
-    assert(prefix == '\n');
-    Log::trace() << "Returning total buffer size: " << data.size();
-
-    return data;
+    return failed;
 }
 
-void Connection::read_binary_async(BinaryCallback callback)
+void Connection::async_send_command(std::string cmd, CommandHandler handler, Timeout timeout)
 {
-    assert(mode_ == Mode::binary);
-    socket_->read_binary_async(callback);
+    queue_command(std::move(cmd), false, timeout,
+                  [handler = std::move(handler)](auto ec, auto) { handler(ec); });
 }
 
-void Connection::read_async(Callback callback)
+void Connection::async_query(std::string query, QueryHandler handler, Timeout timeout)
 {
     assert(mode_ == Mode::ascii);
-    socket_->read_async(callback);
+
+    queue_command(std::move(query), true, timeout, std::move(handler));
 }
 
-std::vector<char> Connection::read_binary_raw()
+void Connection::queue_command(std::string text, bool query, Timeout timeout,
+                               QueryHandler handler)
 {
-    assert(mode_ == Mode::binary);
-
-    char buffer;
+    if (reading())
+    {
+        raise("Asynchronous commands are not possible, while reading a stream");
+    }
 
-    *socket_ >> buffer;
+    pending_commands_.push_back(
+        { std::move(text) + '\n', query, timeout, std::move(handler), next_sequence_++ });
 
-    std::vector<char> data;
+    if (pending_commands_.size() == 1)
+    {
+        next_command();
+    }
+}
 
-    while (buffer == '#')
+void Connection::next_command()
+{
+    if (pending_commands_.empty())
     {
-        char size_size_buffer;
-        *socket_ >> size_size_buffer;
+        return;
+    }
 
-        std::size_t size_size = size_size_buffer - '0';
+    auto& command = pending_commands_.front();
+    Log::debug() << "Sending command: " << command.text.substr(0, command.text.size() - 1);
 
-        auto size_buffer = std::string(size_size, '$');
+    // The timer may have expired for the previous command, before it was cancelled. So each
+    // handler checks, that its command is still the current one.
+    const auto sequence = command.sequence;
+    deadline_.expires_after(command.timeout);
+    deadline_.async_wait([this, sequence](auto ec) {
+        if (ec || pending_commands_.empty() || pending_commands_.front().sequence != sequence)
+        {
+            return;
+        }
 
-        socket_->read(reinterpret_cast<std::byte*>(size_buffer.data()), size_size);
+        auto& command = pending_commands_.front();
+        Log::warn() << "Command timed out: " << command.text.substr(0, command.text.size() - 1);
+        command.timed_out = true;
+        visit([](auto& socket) { socket.cancel(); });
+    });
+
+    visit([this, &command, sequence](auto& socket) {
+        // Just like operator<<, this includes the terminating null byte.
+        auto buffer = asio::buffer(command.text.data(), command.text.size() + 1);
+
+        socket.async_write(buffer, [this, &socket, sequence, query = command.query](auto ec, auto) {
+            if (ec || !query)
+            {
+                complete_command(sequence, ec, std::string());
+                return;
+            }
+
+            socket.async_read_line([this, sequence](auto ec, std::string line) {
+                complete_command(sequence, ec, std::move(line));
+            });
+        });
+    });
+}
 
-        auto size = std::stoull(size_buffer);
-        auto old_size = data.size();
-        data.resize(old_size + size);
+void Connection::complete_command(std::uint64_t sequence, asio::error_code ec, std::string result)
+{
+    if (pending_commands_.empty() || pending_commands_.front().sequence != sequence)
+    {
+        Log::debug() << "Ignoring the stale completion of command " << sequence;
+        return;
+    }
 
-        Log::debug() << "Reading binary chunk of size: " << size;
+    deadline_.cancel();
 
-        socket_->read(reinterpret_cast<std::byte*>(&data[old_size]), size);
+    auto command = std::move(pending_commands_.front());
+    pending_commands_.pop_front();
 
-        *socket_ >> buffer;
+    if (command.timed_out)
+    {
+        ec = asio::error::timed_out;
     }
+    command.handler(ec, std::move(result));
 
-    assert(buffer == '\n');
+    next_command();
+}
+
+const ResyncStats& Connection::resync_stats() const
+{
+    return visit([](const auto& socket) -> const ResyncStats& {
+        return socket.frame_parser().stats();
+    });
+}
 
-    Log::debug() << "Returning total buffer size: " << data.size();
+BinaryData Connection::read_binary(size_t reserved_size)
+{
+    assert(mode_ == Mode::binary);
+
+    BinaryData data(reserved_size);
+    visit([&data](auto& socket) { read_frame(socket, data); });
+
+    Log::trace() << "Returning total buffer size: " << data.size();
 
     return data;
 }
 
+void Connection::read_binary_async(BinaryCallback callback, size_t frame_size)
+{
+    assert(mode_ == Mode::binary);
+    if (!pending_commands_.empty())
+    {
+        raise("Can't read a stream, while asynchronous commands are pending");
+    }
+    visit([&](auto& socket) { socket.read_binary_async(callback, frame_size); });
+}
+
+void Connection::read_async(Callback callback)
+{
+    assert(mode_ == Mode::ascii);
+    if (!pending_commands_.empty())
+    {
+        raise("Can't read a stream, while asynchronous commands are pending");
+    }
+    visit([&](auto& socket) { socket.read_async(callback); });
+}
+
+bool Connection::reading() const
+{
+    return visit([](const auto& socket) { return socket.reading(); });
+}
+
+void Connection::stop_reading()
+{
+    visit([](auto& socket) { socket.stop_reading(); });
+
+    if (mode_ == Mode::binary)
+    {
+        mode(Mode::ascii);
+    }
+}
+
+std::vector<char> Connection::read_binary_raw()
+{
+    assert(mode_ == Mode::binary);
+
+    RawSink sink;
+    visit([&sink](auto& socket) { read_frame(socket, sink); });
+
+    Log::debug() << "Returning total buffer size: " << sink.data.size();
+
+    return std::move(sink.data);
+}
+
 std::string Connection::read_ascii()
 {
     assert(mode_ == Mode::ascii);
 
-    return socket_->read_line();
+    return visit([](auto& socket) { return socket.read_line(); });
 }
 } // namespace lmgd::network
@@ -3,10 +3,22 @@
 #include <lmgd/except.hpp>
 #include <lmgd/log.hpp>
 
-#include <asio/buffers_iterator.hpp>
-#include <asio/read.hpp>
-#include <asio/read_until.hpp>
-#include <asio/write.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+{
+#include <poll.h>
+#include <sys/socket.h>
+}
 
 using asio::ip::tcp;
 
@@ -14,116 +26,195 @@ namespace lmgd
 {
 namespace network
 {
-    NetworkSocket::NetworkSocket(
-        asio::io_service& io_service,
-        const std::string& hostname,
-        int port)
-    : Socket(io_service), socket_(io_service_)
+    namespace
     {
-        open(hostname, port);
-    }
-
-    void NetworkSocket::read(std::byte* data, std::size_t bytes)
-    {
-        Log::trace() << "Reading " << bytes << " bytes from socket...";
-
-        std::size_t reply_length =
-            asio::read(socket_, asio::buffer(reinterpret_cast<char*>(data), bytes));
-
-        Log::trace() << "Received " << reply_length << " bytes from socket.";
-
-        if (reply_length != bytes)
+        void apply(tcp::socket& socket, const TcpSettings& settings)
         {
-            raise("Unexpected number of bytes read from socket");
-        }
-    }
+            socket.set_option(tcp::no_delay(settings.no_delay));
 
-    void NetworkSocket::write(const std::byte* data, std::size_t bytes)
-    {
-        Log::trace() << "Writing " << bytes << " bytes onto socket...";
+            if (settings.receive_buffer > 0)
+            {
+                socket.set_option(asio::socket_base::receive_buffer_size(settings.receive_buffer));
+            }
 
-        std::size_t send_bytes =
-            asio::write(socket_, asio::buffer(reinterpret_cast<const char*>(data), bytes));
+            if (settings.busy_poll > 0)
+            {
+                if (::setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL,
+                                 &settings.busy_poll, sizeof(settings.busy_poll)) < 0)
+                {
+                    Log::warn() << "Failed to enable busy polling: " << std::strerror(errno);
+                }
+            }
+        }
 
-        Log::trace() << "Wrote " << send_bytes << " bytes onto socket.";
+        using Clock = std::chrono::steady_clock;
 
-        if (send_bytes != bytes)
+        std::chrono::milliseconds remaining(Clock::time_point deadline)
         {
-            raise("Unexpected number of bytes written onto socket");
+            return std::max(std::chrono::milliseconds(0),
+                            std::chrono::duration_cast<std::chrono::milliseconds>(
+                                deadline - Clock::now()));
         }
-    }
 
-    std::string NetworkSocket::read_line(char delim)
-    {
-        Log::trace() << "Reading one line from buffer...";
+        // getaddrinfo has no timeout, so a hung resolver must not block the caller. The lookup
+        // runs on a thread of its own, which is left behind, if it takes too long.
+        std::vector<tcp::endpoint> resolve(const std::string& hostname, int port,
+                                           Clock::time_point deadline)
+        {
+            // Usually, the address is given directly
+            asio::error_code ec;
+            auto address = asio::ip::make_address_v4(hostname, ec);
+            if (!ec)
+            {
+                return { tcp::endpoint(address, port) };
+            }
 
-        std::size_t bytes_transferred = asio::read_until(socket_, recv_buffer_, delim);
-        std::string line(
-            asio::buffers_begin(recv_buffer_.data()),
-            asio::buffers_begin(recv_buffer_.data()) + bytes_transferred - 1);
+            struct Lookup
+            {
+                std::mutex mutex;
+                std::condition_variable done_cv;
+                bool done = false;
+                std::vector<tcp::endpoint> endpoints;
+                asio::error_code ec;
+            };
+            auto lookup = std::make_shared<Lookup>();
+
+            std::thread([lookup, hostname, port]() {
+                asio::io_service io_service;
+                tcp::resolver resolver(io_service);
+                tcp::resolver::query query(tcp::v4(), hostname, std::to_string(port));
+
+                asio::error_code ec;
+                std::vector<tcp::endpoint> endpoints;
+                for (auto it = resolver.resolve(query, ec); it != tcp::resolver::iterator(); ++it)
+                {
+                    endpoints.push_back(*it);
+                }
+
+                std::lock_guard<std::mutex> lock(lookup->mutex);
+                lookup->endpoints = std::move(endpoints);
+                lookup->ec = ec;
+                lookup->done = true;
+                lookup->done_cv.notify_one();
+            }).detach();
+
+            std::unique_lock<std::mutex> lock(lookup->mutex);
+            if (!lookup->done_cv.wait_until(lock, deadline, [&lookup]() { return lookup->done; }))
+            {
+                throw TimeoutError("Resolving " + hostname + " timed out");
+            }
+            if (lookup->ec)
+            {
+                raise("Failed to resolve ", hostname, ": ", lookup->ec.message());
+            }
+            if (lookup->endpoints.empty())
+            {
+                raise("Failed to resolve ", hostname, ": no addresses");
+            }
+            return std::move(lookup->endpoints);
+        }
 
-        Log::trace() << "Read line of " << bytes_transferred << " bytes length";
+        // Returns asio::error::timed_out, if the deadline passes
+        asio::error_code connect(tcp::socket& socket, const tcp::endpoint& endpoint,
+                                 Clock::time_point deadline)
+        {
+            // asio's connect always blocks until the kernel gives up, so connect without blocking
+            // and wait with a timeout for it
+            socket.open(tcp::v4());
+            socket.native_non_blocking(true);
 
-        recv_buffer_.consume(bytes_transferred);
-        return line;
-    }
+            asio::error_code ec;
+            if (::connect(socket.native_handle(), endpoint.data(), endpoint.size()) < 0)
+            {
+                ec = asio::error_code(errno, asio::error::get_system_category());
+            }
 
-    void NetworkSocket::open(const std::string& hostname, int port)
-    {
-        tcp::resolver resolver(io_service_);
-        tcp::resolver::query query(tcp::v4(), hostname, std::to_string(port));
-        tcp::resolver::iterator iterator = resolver.resolve(query);
+            if (ec == asio::error::in_progress)
+            {
+                if (!wait_for(socket, POLLOUT, remaining(deadline)))
+                {
+                    socket.close();
+                    return asio::error::timed_out;
+                }
+
+                int error = 0;
+                socklen_t length = sizeof(error);
+                ::getsockopt(socket.native_handle(), SOL_SOCKET, SO_ERROR, &error, &length);
+                ec = asio::error_code(error, asio::error::get_system_category());
+            }
 
-        socket_.connect(*iterator);
-    }
+            if (ec)
+            {
+                socket.close();
+                return ec;
+            }
 
-    void NetworkSocket::close()
-    {
-        socket_.close();
-        recv_buffer_.consume(recv_buffer_.size());
-    }
+            socket.native_non_blocking(false);
+            return ec;
+        }
+    } // namespace
 
-    bool NetworkSocket::is_open() const
+    void connect(tcp::socket& socket, const std::string& hostname, int port,
+                 const TcpSettings& settings, std::chrono::milliseconds timeout)
     {
-        return socket_.is_open();
-    }
+        auto start = Clock::now();
+        auto deadline = start + timeout;
 
-    NetworkSocket::~NetworkSocket()
-    {
-        try
+        // Each address gets the rest of the time, the first ones might be dead
+        asio::error_code ec;
+        for (const auto& endpoint : resolve(hostname, port, deadline))
         {
-            if (socket_.is_open())
+            ec = connect(socket, endpoint, deadline);
+            if (!ec)
+            {
+                break;
+            }
+
+            Log::debug() << "Failed to connect to " << endpoint << ": " << ec.message();
+            if (ec == asio::error::timed_out)
             {
-                close();
+                break;
             }
         }
-        catch (std::exception& e)
+
+        if (ec == asio::error::timed_out)
+        {
+            throw TimeoutError("Connecting to " + hostname + ":" + std::to_string(port) +
+                               " timed out");
+        }
+        if (ec)
         {
-            Log::error() << "Catched exception while closing socket: " << e.what();
+            raise("Failed to connect to ", hostname, ":", port, ": ", ec.message());
         }
+
+        apply(socket, settings);
+
+        Log::debug() << "Connected to " << hostname << ":" << port << " in "
+                     << std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start)
+                            .count()
+                     << " us";
     }
 
-    void NetworkSocket::read_binary_async(BinaryCallback callback)
+    NetworkSocket::NetworkSocket(
+        asio::io_service& io_service,
+        const std::string& hostname,
+        int port,
+        const TcpSettings& settings,
+        Timeout timeout)
+    : Transport(io_service)
     {
-        assert(!binary_line_reader_);
-        assert(!line_reader_);
-        assert(asio_buffer().size() == 0);
-
-        binary_line_reader_ =
-            std::make_unique<AsyncBinaryLineReader<asio::ip::tcp::socket, BinaryCallback>>(
-                asio_socket(), callback);
-        binary_line_reader_->read();
+        timeout_ = timeout;
+        open(hostname, port, settings);
     }
 
-    void NetworkSocket::read_async(Callback callback)
+    NetworkSocket::NetworkSocket(asio::io_service& io_service, int fd) : Transport(io_service)
     {
-        assert(!binary_line_reader_);
-        assert(!line_reader_);
-        assert(asio_buffer().size() == 0);
+        stream_.assign(tcp::v4(), fd);
+    }
 
-        line_reader_ = std::make_unique<AsyncLineReader<asio::ip::tcp::socket, Callback>>(
-            asio_socket(), callback);
-        line_reader_->read();
+    void NetworkSocket::open(const std::string& hostname, int port, const TcpSettings& settings)
+    {
+        connect(stream_, hostname, port, settings, timeout_);
     }
 } // namespace network
 } // namespace lmgd
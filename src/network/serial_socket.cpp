@@ -3,15 +3,21 @@
 #include <lmgd/except.hpp>
 #include <lmgd/log.hpp>
 
-#include <asio/buffers_iterator.hpp>
-#include <asio/read.hpp>
-#include <asio/read_until.hpp>
-#include <asio/write.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <vector>
 
 extern "C"
 {
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 }
 
 namespace lmgd
@@ -19,115 +25,199 @@ namespace lmgd
 namespace network
 {
 
-    SerialSocket::SerialSocket(asio::io_service& io_service, const std::string& port)
-    : Socket(io_service), socket_(io_service_), baud_(57600)
+    SerialSocket::SerialSocket(
+        asio::io_service& io_service,
+        const std::string& port,
+        const SerialSettings& settings)
+    : Transport(io_service), settings_(settings), baud_rate_(settings.baud_rate)
     {
-        open(port, -1);
+        open(port);
     }
 
-    void SerialSocket::read(std::byte* data, std::size_t bytes)
+    SerialSocket::SerialSocket(
+        asio::io_service& io_service,
+        int fd,
+        const SerialSettings& settings)
+    : Transport(io_service), settings_(settings), baud_rate_(settings.baud_rate)
     {
-        Log::trace() << "Reading " << bytes << " bytes from socket...";
-
-        std::size_t reply_length =
-            asio::read(socket_, asio::buffer(reinterpret_cast<char*>(data), bytes));
-
-        Log::trace() << "Received " << reply_length << " bytes from socket.";
-
-        if (reply_length != bytes)
-        {
-            raise("Unexpected number of bytes read from socket");
-        }
+        stream_.assign(fd);
     }
 
-    void SerialSocket::write(const std::byte* data, std::size_t bytes)
+    void SerialSocket::open(const std::string& port)
     {
-        Log::trace() << "Writing " << bytes << " bytes onto socket...";
+        stream_.open(port);
+        configure();
+    }
 
-        std::size_t send_bytes =
-            asio::write(socket_, asio::buffer(reinterpret_cast<const char*>(data), bytes));
+    void SerialSocket::configure()
+    {
+        using asio::serial_port_base;
 
-        Log::trace() << "Wrote " << send_bytes << " bytes onto socket.";
+        stream_.set_option(serial_port_base::baud_rate(baud_rate_));
 
-        if (send_bytes != bytes)
+        switch (settings_.flow_control)
         {
-            raise("Unexpected number of bytes written onto socket");
+        case SerialSettings::FlowControl::none:
+            stream_.set_option(serial_port_base::flow_control(serial_port_base::flow_control::none));
+            break;
+        case SerialSettings::FlowControl::software:
+            stream_.set_option(
+                serial_port_base::flow_control(serial_port_base::flow_control::software));
+            break;
+        case SerialSettings::FlowControl::hardware:
+            stream_.set_option(
+                serial_port_base::flow_control(serial_port_base::flow_control::hardware));
+            break;
         }
-    }
 
-    std::string SerialSocket::read_line(char delim)
-    {
-        Log::trace() << "Reading one line from buffer...";
+        auto fd = stream_.native_handle();
 
-        std::size_t bytes_transferred = asio::read_until(socket_, recv_buffer_, delim);
-        std::string line(
-            asio::buffers_begin(recv_buffer_.data()),
-            asio::buffers_begin(recv_buffer_.data()) + bytes_transferred - 1);
+        termios tio;
+        if (tcgetattr(fd, &tio) < 0)
+        {
+            raise("Failed to get the terminal attributes: ", std::strerror(errno));
+        }
+        tio.c_cc[VMIN] = settings_.min_bytes;
+        tio.c_cc[VTIME] = settings_.timeout;
+        if (tcsetattr(fd, TCSANOW, &tio) < 0)
+        {
+            raise("Failed to set the terminal attributes: ", std::strerror(errno));
+        }
 
-        Log::trace() << "Read line of " << bytes_transferred << " bytes length";
+#ifdef __linux__
+        if (settings_.low_latency)
+        {
+            serial_struct serial;
+            if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+            {
+                serial.flags |= ASYNC_LOW_LATENCY;
+                if (ioctl(fd, TIOCSSERIAL, &serial) < 0)
+                {
+                    Log::warn() << "Failed to set low latency mode: " << std::strerror(errno);
+                }
+            }
+            else
+            {
+                Log::debug() << "Serial port doesn't support low latency mode";
+            }
+        }
+#endif
 
-        recv_buffer_.consume(bytes_transferred);
-        return line;
+        Log::debug() << "Serial port running at " << baud_rate_ << " baud";
     }
 
-    void SerialSocket::open(const std::string& port, int)
+    void SerialSocket::set_baud_rate(unsigned baud_rate)
     {
-        socket_.open(port);
-        socket_.set_option(baud_);
-    }
+        // make sure everything is out, before the rate changes
+        tcdrain(stream_.native_handle());
 
-    void SerialSocket::flush()
-    {
-        tcflush(socket_.lowest_layer().native_handle(), TCIOFLUSH);
-    }
+        baud_rate_ = baud_rate;
+        stream_.set_option(asio::serial_port_base::baud_rate(baud_rate_));
 
-    void SerialSocket::close()
-    {
-        socket_.close();
+        flush();
         recv_buffer_.consume(recv_buffer_.size());
     }
 
-    bool SerialSocket::is_open() const
+    void SerialSocket::send(const std::string& command)
     {
-        return socket_.is_open();
+        // Just like the commands sent by the connection, including the terminating null byte
+        write(reinterpret_cast<const std::byte*>(command.data()), command.size() + 1);
     }
 
-    SerialSocket::~SerialSocket()
+    bool SerialSocket::verify()
     {
-        try
+        send("*idn?\n");
+
+        auto fd = stream_.native_handle();
+        auto deadline = std::chrono::steady_clock::now() + verify_timeout;
+        std::string line;
+
+        while (line.find('\n') == std::string::npos)
         {
-            if (socket_.is_open())
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0)
             {
-                close();
+                return false;
             }
+
+            pollfd pfd{ fd, POLLIN, 0 };
+            auto ret = ::poll(&pfd, 1, remaining.count());
+            if (ret < 0 && errno != EINTR)
+            {
+                raise("Failed to poll serial port: ", std::strerror(errno));
+            }
+            if (ret <= 0)
+            {
+                continue;
+            }
+
+            char buffer[256];
+            line.append(buffer, stream_.read_some(asio::buffer(buffer)));
         }
-        catch (std::exception& e)
-        {
-            Log::error() << "Catched exception while closing socket: " << e.what();
-        }
+
+        line.resize(line.find('\n'));
+        Log::debug() << "Verification at " << baud_rate_ << " baud: " << line;
+
+        // At a wrong baud rate, we only receive garbage, if anything
+        return std::count(line.begin(), line.end(), ',') == 3;
     }
 
-    void SerialSocket::read_binary_async(BinaryCallback callback)
+    void SerialSocket::negotiate()
     {
-        assert(!binary_line_reader_);
-        assert(!line_reader_);
-        assert(asio_buffer().size() == 0);
-
-        binary_line_reader_ =
-            std::make_unique<AsyncBinaryLineReader<asio::serial_port, BinaryCallback>>(
-                asio_socket(), callback);
-        binary_line_reader_->read();
+        auto rates = settings_.negotiate_baud_rates;
+        std::sort(rates.begin(), rates.end(), std::greater<>());
+
+        // The device may still run at a rate negotiated earlier, so look for it first.
+        std::vector<unsigned> candidates{ settings_.baud_rate };
+        candidates.insert(candidates.end(), rates.begin(), rates.end());
+
+        auto current = std::find_if(candidates.begin(), candidates.end(), [this](auto rate) {
+            set_baud_rate(rate);
+            return verify();
+        });
+
+        if (current == candidates.end())
+        {
+            raise("The device doesn't answer at any of the configured baud rates");
+        }
+
+        auto current_rate = *current;
+
+        for (auto rate : rates)
+        {
+            if (rate <= current_rate)
+            {
+                break;
+            }
+
+            Log::debug() << "Trying to switch to " << rate << " baud";
+
+            send(settings_.baud_rate_command + " " + std::to_string(rate) + "\n");
+            set_baud_rate(rate);
+
+            if (verify())
+            {
+                Log::info() << "Negotiated baud rate of " << rate;
+                return;
+            }
+
+            // Switch back, in case the device switched, but the link isn't stable
+            send(settings_.baud_rate_command + " " + std::to_string(current_rate) + "\n");
+            set_baud_rate(current_rate);
+
+            if (!verify())
+            {
+                raise("Lost the device while negotiating the baud rate");
+            }
+        }
+
+        Log::info() << "Using baud rate of " << current_rate;
     }
 
-    void SerialSocket::read_async(Callback callback)
+    void SerialSocket::flush()
     {
-        assert(!binary_line_reader_);
-        assert(!line_reader_);
-        assert(asio_buffer().size() == 0);
-
-        line_reader_ =
-            std::make_unique<AsyncLineReader<asio::serial_port, Callback>>(asio_socket(), callback);
-        line_reader_->read();
+        tcflush(stream_.lowest_layer().native_handle(), TCIOFLUSH);
     }
 } // namespace network
 } // namespace lmgd
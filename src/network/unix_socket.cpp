@@ -0,0 +1,27 @@
+#include <lmgd/network/unix_socket.hpp>
+
+#include <lmgd/log.hpp>
+
+namespace lmgd
+{
+namespace network
+{
+    UnixSocket::UnixSocket(asio::io_service& io_service, const std::string& path)
+    : Transport(io_service)
+    {
+        open(path);
+    }
+
+    UnixSocket::UnixSocket(asio::io_service& io_service, int fd) : Transport(io_service)
+    {
+        stream_.assign(asio::local::stream_protocol(), fd);
+    }
+
+    void UnixSocket::open(const std::string& path)
+    {
+        Log::debug() << "Connecting to unix domain socket: " << path;
+
+        stream_.connect(asio::local::stream_protocol::endpoint(path));
+    }
+} // namespace network
+} // namespace lmgd
@@ -0,0 +1,52 @@
+#include <lmgd/network/uring_socket.hpp>
+
+#include <lmgd/network/network_socket.hpp>
+
+#include <lmgd/except.hpp>
+#include <lmgd/log.hpp>
+
+#include <asio/ip/tcp.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+{
+#include <unistd.h>
+}
+
+using asio::ip::tcp;
+
+namespace lmgd::network
+{
+UringSocket::UringSocket(asio::io_service& io_service, const std::string& hostname, int port,
+                         const TcpSettings& settings, Timeout timeout)
+: Transport(io_service)
+{
+    timeout_ = timeout;
+    open(hostname, port, settings);
+}
+
+UringSocket::UringSocket(asio::io_service& io_service, int fd) : Transport(io_service)
+{
+    stream_.assign(fd);
+}
+
+void UringSocket::open(const std::string& hostname, int port, const TcpSettings& settings)
+{
+    // Let asio do the name resolution and the connect, then take over the file descriptor.
+    tcp::socket socket(io_service_);
+    connect(socket, hostname, port, settings, timeout_);
+
+    auto fd = ::dup(socket.native_handle());
+    if (fd < 0)
+    {
+        raise("Failed to take over socket: ", std::strerror(errno));
+    }
+    socket.close();
+
+    stream_.assign(fd);
+
+    Log::debug() << "Using io_uring transport for " << hostname << ":" << port;
+}
+} // namespace lmgd::network
@@ -0,0 +1,435 @@
+#include <lmgd/network/uring_stream.hpp>
+
+#include <lmgd/except.hpp>
+#include <lmgd/log.hpp>
+
+#include <asio/post.hpp>
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+{
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+namespace lmgd::network
+{
+namespace
+{
+    constexpr unsigned queue_depth = 8;
+    constexpr int buffer_group = 0;
+    constexpr std::uint64_t recv_tag = 1;
+    constexpr std::uint64_t cancel_tag = 2;
+} // namespace
+
+UringStream::UringStream(asio::io_service& io_service) : io_service_(io_service), event_(io_service)
+{
+    if (auto ret = io_uring_queue_init(queue_depth, &ring_, 0); ret < 0)
+    {
+        raise("Failed to setup io_uring: ", std::strerror(-ret));
+    }
+
+    // The destructor doesn't run for a half constructed stream, so clean up the ring here
+    try
+    {
+        int ret = 0;
+        buf_ring_ = io_uring_setup_buf_ring(&ring_, num_buffers, buffer_group, 0, &ret);
+        if (!buf_ring_)
+        {
+            raise("Failed to register io_uring buffers: ", std::strerror(-ret));
+        }
+
+        storage_ = std::make_unique<std::byte[]>(num_buffers * buffer_size);
+        for (unsigned short i = 0; i < num_buffers; i++)
+        {
+            provide(i);
+        }
+
+        auto event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd < 0)
+        {
+            raise("Failed to create eventfd: ", std::strerror(errno));
+        }
+        ret = io_uring_register_eventfd(&ring_, event_fd);
+        if (ret < 0)
+        {
+            ::close(event_fd);
+            raise("Failed to register eventfd with io_uring: ", std::strerror(-ret));
+        }
+
+        asio::error_code ec;
+        event_.assign(event_fd, ec);
+        if (ec)
+        {
+            ::close(event_fd);
+            raise("Failed to assign eventfd: ", ec.message());
+        }
+    }
+    catch (...)
+    {
+        if (buf_ring_)
+        {
+            io_uring_free_buf_ring(&ring_, buf_ring_, num_buffers, buffer_group);
+        }
+        io_uring_queue_exit(&ring_);
+        throw;
+    }
+}
+
+UringStream::~UringStream()
+{
+    close();
+    event_.close();
+    io_uring_free_buf_ring(&ring_, buf_ring_, num_buffers, buffer_group);
+    io_uring_queue_exit(&ring_);
+}
+
+void UringStream::assign(int fd)
+{
+    assert(fd_ < 0);
+    fd_ = fd;
+    error_ = {};
+}
+
+void UringStream::close()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+
+    if (armed_)
+    {
+        if (auto sqe = next_sqe())
+        {
+            io_uring_prep_cancel_fd(sqe, fd_, 0);
+            io_uring_sqe_set_data64(sqe, cancel_tag);
+            io_uring_submit(&ring_);
+        }
+        else
+        {
+            Log::warn() << "Failed to cancel the io_uring receive, the submission queue is full";
+        }
+        armed_ = false;
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+
+    event_.cancel();
+}
+
+io_uring_sqe* UringStream::next_sqe()
+{
+    auto sqe = io_uring_get_sqe(&ring_);
+    if (!sqe)
+    {
+        // Make room by submitting everything queued so far
+        io_uring_submit(&ring_);
+        sqe = io_uring_get_sqe(&ring_);
+    }
+    return sqe;
+}
+
+void UringStream::provide(unsigned short buffer_id)
+{
+    io_uring_buf_ring_add(
+        buf_ring_,
+        storage_.get() + buffer_id * buffer_size,
+        buffer_size,
+        buffer_id,
+        io_uring_buf_ring_mask(num_buffers),
+        0);
+    io_uring_buf_ring_advance(buf_ring_, 1);
+}
+
+void UringStream::arm()
+{
+    if (armed_ || released_ || fd_ < 0 || error_)
+    {
+        return;
+    }
+
+    Log::trace() << "UringStream::arm()";
+
+    auto sqe = next_sqe();
+    if (!sqe)
+    {
+        raise("Failed to arm the io_uring receive, the submission queue is full");
+    }
+    io_uring_prep_recv_multishot(sqe, fd_, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    io_uring_sqe_set_data64(sqe, recv_tag);
+    io_uring_submit(&ring_);
+
+    armed_ = true;
+}
+
+std::vector<std::byte> UringStream::take_received()
+{
+    released_ = true;
+
+    if (armed_)
+    {
+        auto sqe = next_sqe();
+        if (!sqe)
+        {
+            raise("Failed to cancel the io_uring receive, the submission queue is full");
+        }
+        io_uring_prep_cancel64(sqe, recv_tag, 0);
+        io_uring_sqe_set_data64(sqe, cancel_tag);
+        io_uring_submit(&ring_);
+
+        // The receive may still complete some data before its final completion
+        while (armed_)
+        {
+            io_uring_cqe* cqe;
+            if (auto ret = io_uring_wait_cqe(&ring_, &cqe); ret < 0 && ret != -EINTR)
+            {
+                raise("Failed to cancel the io_uring receive: ", std::strerror(-ret));
+            }
+            reap();
+        }
+    }
+
+    std::vector<std::byte> result;
+    while (received_count_ > 0)
+    {
+        auto& received = received_[received_head_];
+        auto data = storage_.get() + received.buffer_id * buffer_size;
+        result.insert(result.end(), data + received.offset, data + received.size);
+
+        provide(received.buffer_id);
+        received_head_ = (received_head_ + 1) % num_buffers;
+        --received_count_;
+    }
+    return result;
+}
+
+void UringStream::reap()
+{
+    io_uring_cqe* cqe;
+    while (io_uring_peek_cqe(&ring_, &cqe) == 0)
+    {
+        handle(*cqe);
+        io_uring_cqe_seen(&ring_, cqe);
+    }
+}
+
+void UringStream::handle(const io_uring_cqe& cqe)
+{
+    if (cqe.user_data != recv_tag)
+    {
+        return;
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+    {
+        // The multishot receive terminated, e.g., because all buffers are in use.
+        armed_ = false;
+    }
+
+    if (cqe.res > 0)
+    {
+        assert(cqe.flags & IORING_CQE_F_BUFFER);
+        assert(received_count_ < num_buffers);
+
+        auto buffer_id = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        received_[(received_head_ + received_count_) % num_buffers] = {
+            buffer_id, 0, static_cast<std::size_t>(cqe.res)
+        };
+        ++received_count_;
+    }
+    else if (cqe.res == 0)
+    {
+        error_ = asio::error::eof;
+    }
+    else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+    {
+        error_ = asio::error_code(-cqe.res, asio::error::get_system_category());
+    }
+}
+
+std::size_t UringStream::copy(asio::mutable_buffer buffer)
+{
+    auto dest = static_cast<std::byte*>(buffer.data());
+    std::size_t copied = 0;
+
+    while (received_count_ > 0 && copied < buffer.size())
+    {
+        auto& received = received_[received_head_];
+        auto bytes = std::min(buffer.size() - copied, received.size - received.offset);
+
+        std::memcpy(
+            dest + copied,
+            storage_.get() + received.buffer_id * buffer_size + received.offset,
+            bytes);
+        copied += bytes;
+        received.offset += bytes;
+
+        if (received.offset == received.size)
+        {
+            provide(received.buffer_id);
+            received_head_ = (received_head_ + 1) % num_buffers;
+            --received_count_;
+        }
+    }
+
+    // Buffers are available again, so restart the receive, if it ran out of buffers before.
+    arm();
+
+    return copied;
+}
+
+std::size_t UringStream::receive(asio::mutable_buffer buffer, asio::error_code& ec)
+{
+    ec = {};
+
+    while (received_count_ == 0)
+    {
+        if (error_)
+        {
+            ec = error_;
+            return 0;
+        }
+
+        arm();
+
+        io_uring_cqe* cqe;
+        if (auto ret = io_uring_wait_cqe(&ring_, &cqe); ret < 0 && ret != -EINTR)
+        {
+            ec = asio::error_code(-ret, asio::error::get_system_category());
+            return 0;
+        }
+
+        reap();
+    }
+
+    return copy(buffer);
+}
+
+bool UringStream::wait_readable(std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (received_count_ == 0 && !error_)
+    {
+        arm();
+
+        auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+        {
+            return false;
+        }
+
+        __kernel_timespec ts{ remaining.count() / 1'000'000'000,
+                              remaining.count() % 1'000'000'000 };
+        io_uring_cqe* cqe;
+        auto ret = io_uring_wait_cqe_timeout(&ring_, &cqe, &ts);
+        if (ret == -ETIME)
+        {
+            return false;
+        }
+        if (ret < 0 && ret != -EINTR)
+        {
+            error_ = asio::error_code(-ret, asio::error::get_system_category());
+        }
+
+        reap();
+    }
+
+    return true;
+}
+
+std::size_t UringStream::send(asio::const_buffer buffer, asio::error_code& ec)
+{
+    ec = {};
+
+    while (true)
+    {
+        auto ret = ::send(fd_, buffer.data(), buffer.size(), MSG_NOSIGNAL);
+        if (ret >= 0)
+        {
+            return ret;
+        }
+        if (errno != EINTR)
+        {
+            ec = asio::error_code(errno, asio::error::get_system_category());
+            return 0;
+        }
+    }
+}
+
+void UringStream::async_receive(asio::mutable_buffer buffer, ReadHandler handler)
+{
+    assert(!pending_handler_);
+
+    if (received_count_ > 0 || error_ || fd_ < 0)
+    {
+        auto ec = fd_ < 0 ? asio::error::bad_descriptor : asio::error_code();
+        auto bytes = copy(buffer);
+        if (bytes == 0 && !ec)
+        {
+            ec = error_;
+        }
+
+        asio::post(io_service_,
+                   [handler = std::move(handler), ec, bytes]() { handler(ec, bytes); });
+        return;
+    }
+
+    pending_buffer_ = buffer;
+    pending_handler_ = std::move(handler);
+
+    arm();
+    wait();
+}
+
+void UringStream::wait()
+{
+    if (waiting_)
+    {
+        return;
+    }
+    waiting_ = true;
+
+    auto buffer = asio::buffer(&event_count_, sizeof(event_count_));
+    event_.async_read_some(buffer, [this](asio::error_code ec, std::size_t) {
+        waiting_ = false;
+
+        if (!pending_handler_)
+        {
+            return;
+        }
+
+        if (ec)
+        {
+            auto handler = std::move(pending_handler_);
+            pending_handler_ = nullptr;
+            handler(ec, 0);
+            return;
+        }
+
+        reap();
+
+        if (received_count_ == 0 && !error_)
+        {
+            arm();
+            wait();
+            return;
+        }
+
+        auto handler = std::move(pending_handler_);
+        pending_handler_ = nullptr;
+
+        auto bytes = copy(pending_buffer_);
+        handler(bytes > 0 ? asio::error_code() : error_, bytes);
+    });
+}
+} // namespace lmgd::network
@@ -0,0 +1,217 @@
+#include <lmgd/source/check_config.hpp>
+
+#include <lmgd/source/compression.hpp>
+#include <lmgd/source/flush_policy.hpp>
+#include <lmgd/source/queue_policy.hpp>
+
+#include <lmgd/except.hpp>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lmgd::source
+{
+namespace
+{
+    // Size of a chunk on the wire, i.e., with its header #<n><len>
+    std::size_t chunk_size(std::size_t payload)
+    {
+        return 2 + std::to_string(payload).size() + payload;
+    }
+
+    std::string header(std::size_t payload)
+    {
+        auto size = std::to_string(payload);
+        return "#" + std::to_string(size.size()) + size;
+    }
+} // namespace
+
+std::unique_ptr<device::Device> check_config(const nlohmann::json& config)
+{
+    if (config.value("chunk_size", 0) < 0)
+    {
+        raise("The chunk_size must not be negative");
+    }
+
+    queue_settings(config);
+
+    // Two channels with the same name would end up in the same metrics
+    std::set<std::string> names;
+    for (const auto& channel : config.at("channels"))
+    {
+        auto name = channel.at("name").get<std::string>();
+        if (!names.insert(name).second)
+        {
+            raise("There are several channels named ", name);
+        }
+    }
+
+    auto device = std::make_unique<device::Device>(config);
+    compression::policies(config, *device);
+    flush_policies(config, *device);
+    return device;
+}
+
+std::vector<nlohmann::json> device_configs(const nlohmann::json& config)
+{
+    auto it = config.find("devices");
+    if (it == config.end())
+    {
+        return { config };
+    }
+
+    if (!it->is_array() || it->empty())
+    {
+        raise("The devices must be a non-empty list");
+    }
+
+    auto defaults = config;
+    defaults.erase("devices");
+
+    std::vector<nlohmann::json> result;
+    for (const auto& device : *it)
+    {
+        if (!device.is_object())
+        {
+            raise("Each of the devices must be an object");
+        }
+
+        auto merged = defaults;
+        merged.update(device);
+        result.push_back(std::move(merged));
+    }
+    return result;
+}
+
+std::string device_key(const nlohmann::json& device_config)
+{
+    const auto& device = device_config.at("measurement").at("device");
+    auto serial = device.value("serial", "");
+    if (!serial.empty())
+    {
+        return serial;
+    }
+
+    // Devices on a serial line have a port instead of an address
+    return device.value("address", device.value("port", ""));
+}
+
+std::vector<std::unique_ptr<device::Device>> check_configs(const nlohmann::json& config)
+{
+    std::vector<std::unique_ptr<device::Device>> devices;
+
+    std::set<std::string> keys;
+    std::set<std::string> channels;
+    std::set<std::string> stats_prefixes;
+    std::set<std::string> handover_paths;
+
+    for (const auto& device_config : device_configs(config))
+    {
+        devices.push_back(check_config(device_config));
+
+        const auto& device = device_config.at("measurement").at("device");
+        auto key = device_key(device_config);
+        if (!keys.insert(key).second)
+        {
+            raise("There are several configs for the device ", key);
+        }
+        auto serial = device.value("serial", "");
+
+        // The metrics are named after the channels, the names within a device are checked above
+        for (const auto& channel : device_config.at("channels"))
+        {
+            auto name = channel.at("name").get<std::string>();
+            if (!channels.insert(name).second)
+            {
+                raise("There are channels named ", name, " on several devices");
+            }
+        }
+
+        auto prefix = device.value("stats_prefix", "lmgd." + serial);
+        if (!stats_prefixes.insert(prefix).second)
+        {
+            raise("There are several devices with the stats_prefix ", prefix);
+        }
+
+        auto handover = device.value("handover", "");
+        if (!handover.empty() && !handover_paths.insert(handover).second)
+        {
+            raise("There are several devices with the handover socket ", handover);
+        }
+    }
+
+    return devices;
+}
+
+void describe(const device::Device& device, std::ostream& out)
+{
+    auto gapless = device.measurement_mode() == device::MeasurementMode::gapless;
+    auto binary = device.data_format() == network::Connection::Mode::binary;
+
+    out << "Mode: " << (gapless ? "gapless" : "cycle") << ", "
+        << (binary ? "binary" : "ascii") << " data, " << device.sampling_rate()
+        << " Hz requested\n";
+
+    out << "\nTracks:\n";
+    for (const auto& track : device.get_tracks())
+    {
+        out << "  " << track.id() << ": " << track.name();
+        if (gapless)
+        {
+            out << " (" << track.get_action_command(device.measurement_mode()) << ")";
+        }
+        out << '\n';
+    }
+
+    const auto& setup = device.setup_commands();
+    out << "\nSetup commands, each line followed by :SYST:ERR:ALL?:\n";
+    for (const auto& line : setup.lines())
+    {
+        out << "  " << setup.join(line) << (line.optional ? " (optional)" : "") << '\n';
+    }
+
+    const auto tracks = device.get_tracks().size();
+
+    if (gapless)
+    {
+        // The length of the lists is only known, once the device is set up
+        out << "\nAction: ACTN;TSCYCL?;DURCYCL?";
+        for (std::size_t i = 0; i < tracks; i++)
+        {
+            out << "; GLPVAL? " << i << ", (0:n-1)";
+        }
+        out << "\n\nFrame layout, n is the gap length reported by the device:\n";
+        out << "  " << header(8) << " <int64>            cycle start in ns\n";
+        out << "  " << header(8) << " <int64>            cycle duration in ns\n";
+        for (const auto& track : device.get_tracks())
+        {
+            out << "  #<k><8+4n> <int64 n> <float>*n  " << track.name() << '\n';
+        }
+        out << "  \\n\n";
+        out << "Frame size: 16 + " << tracks << " * (8 + 4n) bytes of values, "
+            << 2 * chunk_size(8) + 1 << " + " << tracks << " * (10 + 4n + digits(8 + 4n))"
+            << " bytes on the wire\n";
+        return;
+    }
+
+    out << "\nAction: " << device.action_command() << '\n';
+
+    if (!binary)
+    {
+        out << "\nFrame layout: one line of " << tracks << " values separated by ';'\n";
+        return;
+    }
+
+    out << "\nFrame layout:\n";
+    for (const auto& track : device.get_tracks())
+    {
+        out << "  " << header(sizeof(float)) << " <float>  " << track.name() << '\n';
+    }
+    out << "  \\n\n";
+    out << "Frame size: " << device.frame_size() << " bytes of values, "
+        << tracks * chunk_size(sizeof(float)) + 1 << " bytes on the wire\n";
+}
+} // namespace lmgd::source
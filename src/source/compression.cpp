@@ -0,0 +1,172 @@
+#include <lmgd/source/compression.hpp>
+
+#include <lmgd/source/track_settings.hpp>
+
+#include <lmgd/except.hpp>
+
+#include <chrono>
+#include <limits>
+#include <string>
+
+namespace lmgd::source::compression
+{
+namespace
+{
+    // At most this many samples in a row are left out by default, as lmgd always did
+    constexpr int default_max_repeats = 8;
+
+    std::int64_t heartbeat(const nlohmann::json& config, double sampling_rate)
+    {
+        double heartbeat = (default_max_repeats + 1) / sampling_rate;
+        if (config.count("heartbeat"))
+        {
+            heartbeat = config["heartbeat"].get<double>();
+            if (!(heartbeat > 0))
+            {
+                raise("The heartbeat of a compression policy must be positive");
+            }
+        }
+
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::duration<double>(heartbeat))
+            .count();
+    }
+
+    double non_negative(const nlohmann::json& config, const std::string& key)
+    {
+        auto value = config.value(key, 0.);
+        if (!(value >= 0))
+        {
+            raise("The ", key, " of a compression policy must not be negative");
+        }
+        return value;
+    }
+
+    Policy parse(const nlohmann::json& config, double sampling_rate)
+    {
+        auto policy = config.at("policy").get<std::string>();
+
+        if (policy == None::name)
+        {
+            return None{};
+        }
+        if (policy == Dedup::name)
+        {
+            Dedup result;
+            result.heartbeat = heartbeat(config, sampling_rate);
+            return result;
+        }
+        if (policy == Deadband::name)
+        {
+            Deadband result;
+            result.heartbeat = heartbeat(config, sampling_rate);
+            result.absolute = non_negative(config, "absolute");
+            result.relative = non_negative(config, "relative");
+            return result;
+        }
+        if (policy == SwingingDoor::name)
+        {
+            SwingingDoor result;
+            result.heartbeat = heartbeat(config, sampling_rate);
+            result.max_error = non_negative(config, "max_error");
+            return result;
+        }
+
+        raise("Unknown compression policy: ", policy);
+    }
+
+    // The samples go out as doubles, so the float NaN survives as null
+    nlohmann::json value(double value)
+    {
+        return std::isnan(value) ? nlohmann::json() : nlohmann::json(value);
+    }
+
+    double value(const nlohmann::json& value)
+    {
+        return value.is_null() ? std::numeric_limits<double>::quiet_NaN() : value.get<double>();
+    }
+} // namespace
+
+nlohmann::json Dedup::state() const
+{
+    return { { "last_value", value(last_value) }, { "last_time", last_time } };
+}
+
+void Dedup::restore(const nlohmann::json& state)
+{
+    last_value = value(state.at("last_value"));
+    last_time = state.at("last_time").get<std::int64_t>();
+}
+
+nlohmann::json Deadband::state() const
+{
+    return { { "last_value", value(last_value) }, { "last_time", last_time } };
+}
+
+void Deadband::restore(const nlohmann::json& state)
+{
+    last_value = value(state.at("last_value"));
+    last_time = state.at("last_time").get<std::int64_t>();
+}
+
+nlohmann::json SwingingDoor::state() const
+{
+    return {
+        { "has_pivot", has_pivot },
+        { "pivot_time", pivot_time },
+        { "pivot_value", value(pivot_value) },
+        { "has_last", has_last },
+        { "last_time", last_time },
+        { "last_value", value(last_value) },
+        // NaN after a NaN sample
+        { "upper", value(upper) },
+        { "lower", value(lower) },
+    };
+}
+
+void SwingingDoor::restore(const nlohmann::json& state)
+{
+    has_pivot = state.at("has_pivot").get<bool>();
+    pivot_time = state.at("pivot_time").get<std::int64_t>();
+    pivot_value = value(state.at("pivot_value"));
+    has_last = state.at("has_last").get<bool>();
+    last_time = state.at("last_time").get<std::int64_t>();
+    last_value = value(state.at("last_value"));
+    upper = value(state.at("upper"));
+    lower = value(state.at("lower"));
+}
+
+const char* name(const Policy& policy)
+{
+    return std::visit([](const auto& p) { return p.name; }, policy);
+}
+
+std::vector<Policy> policies(const nlohmann::json& config, const device::Device& device)
+{
+    const auto mode = device.measurement_mode();
+    check_track_settings(config, "compression", mode);
+
+    std::vector<Policy> result;
+
+    for (const auto& track : device.get_tracks())
+    {
+        nlohmann::json fallback = { { "policy", None::name } };
+        if (track.bandwidth() == device::MetricBandwidth::narrow)
+        {
+            fallback["policy"] = Dedup::name;
+        }
+
+        try
+        {
+            auto policy = track_setting(config, "compression", track, mode, fallback);
+            result.push_back(parse(policy, device.sampling_rate()));
+        }
+        catch (std::exception& e)
+        {
+            raise("Invalid compression for ", track.name(), ": ", e.what());
+        }
+    }
+
+    return result;
+}
+} // namespace lmgd::source::compression
@@ -0,0 +1,130 @@
+#include <lmgd/source/config_diff.hpp>
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+namespace lmgd::source
+{
+namespace
+{
+    std::set<std::string> keys(const nlohmann::json& a, const nlohmann::json& b)
+    {
+        std::set<std::string> result;
+        for (const auto& object : { a, b })
+        {
+            for (auto it = object.begin(); it != object.end(); ++it)
+            {
+                result.insert(it.key());
+            }
+        }
+        return result;
+    }
+
+    const nlohmann::json& value(const nlohmann::json& object, const std::string& key)
+    {
+        static const nlohmann::json null;
+
+        auto it = object.find(key);
+        return it == object.end() ? null : *it;
+    }
+
+    ConfigChange diff_channel(const nlohmann::json& old_channel, const nlohmann::json& new_channel)
+    {
+        auto change = ConfigChange::none;
+
+        for (const auto& key : keys(old_channel, new_channel))
+        {
+            if (value(old_channel, key) == value(new_channel, key))
+            {
+                continue;
+            }
+
+            if (key == "metrics" || key == "coupling")
+            {
+                // changes the tracks or the coupling, which is set for all channels at once
+                return ConfigChange::full;
+            }
+            else if (key == "current_range" || key == "voltage_range")
+            {
+                change = ConfigChange::ranges;
+            }
+            else
+            {
+                // the name and anything else, which we don't use for the device setup
+                change = std::max(change, ConfigChange::host);
+            }
+        }
+
+        return change;
+    }
+} // namespace
+
+ConfigChange diff(const nlohmann::json& old_config, const nlohmann::json& new_config)
+{
+    if (!old_config.is_object() || !new_config.is_object())
+    {
+        return ConfigChange::full;
+    }
+
+    auto change = ConfigChange::none;
+
+    for (const auto& key : keys(old_config, new_config))
+    {
+        const auto& old_value = value(old_config, key);
+        const auto& new_value = value(new_config, key);
+
+        if (old_value == new_value)
+        {
+            continue;
+        }
+
+        if (key == "chunk_size" || key == "flush" || key == "frame_queue")
+        {
+            change = std::max(change, ConfigChange::host);
+        }
+        else if (key == "measurement")
+        {
+            // The stats prefix is the only setting in there, which doesn't concern the device
+            auto old_measurement = old_value;
+            auto new_measurement = new_value;
+            if (old_measurement.is_object() && new_measurement.is_object() &&
+                old_measurement["device"].is_object() && new_measurement["device"].is_object())
+            {
+                old_measurement["device"].erase("stats_prefix");
+                new_measurement["device"].erase("stats_prefix");
+            }
+
+            if (old_measurement != new_measurement)
+            {
+                return ConfigChange::full;
+            }
+            change = std::max(change, ConfigChange::host);
+        }
+        else if (key == "channels")
+        {
+            if (!old_value.is_array() || !new_value.is_array() ||
+                old_value.size() != new_value.size())
+            {
+                return ConfigChange::full;
+            }
+
+            for (std::size_t i = 0; i < old_value.size(); i++)
+            {
+                change = std::max(change, diff_channel(old_value[i], new_value[i]));
+                if (change == ConfigChange::full)
+                {
+                    return change;
+                }
+            }
+        }
+        else
+        {
+            // better safe than sorry
+            return ConfigChange::full;
+        }
+    }
+
+    return change;
+}
+} // namespace lmgd::source
@@ -0,0 +1,1267 @@
+#include <lmgd/source/device_session.hpp>
+
+#include <lmgd/source/source.hpp>
+
+#include <lmgd/source/compression.hpp>
+#include <lmgd/source/flush_policy.hpp>
+
+#include <lmgd/device/device.hpp>
+#include <lmgd/log.hpp>
+
+#include <metricq/ostream.hpp>
+
+#include <nitro/lang/enumerate.hpp>
+
+#include <asio/post.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <utility>
+#include <set>
+#include <string>
+#include <system_error>
+
+namespace lmgd::source
+{
+
+DeviceSession::DeviceSession(Source& source, bool drop_data)
+: source_(source),
+  io_service_(source.io_service),
+  timer_(io_service_),
+  reconnect_timer_(io_service_),
+  flush_wheel_(io_service_, [this](auto index) { this->on_flush_due(index); }),
+  device_thread_([this](auto error) {
+      asio::post(io_service_, [this, error]() { this->on_device_error(error); });
+  }),
+  frames_(frame_queue_size),
+  drop_data_(drop_data),
+  stats_(source, io_service_)
+{
+}
+
+void DeviceSession::request_stop()
+{
+    stop_requested_ = true;
+    wake_producer();
+
+    if (device_state_ == DeviceState::recording && !handover_)
+    {
+        stop_recording();
+    }
+    else if (device_state_ == DeviceState::reconnecting && reconnect_timer_.cancel() > 0)
+    {
+        device_state_ = DeviceState::none;
+    }
+    // otherwise, the setup of the device is still running and will check stop_requested_, or
+    // we hand over the recording and stop afterwards anyway
+}
+
+void DeviceSession::retire()
+{
+    if (retired_ || stop_requested_)
+    {
+        return;
+    }
+
+    Log::info() << log_prefix_ << "The device was removed from the config. Stop.";
+    retired_ = true;
+    request_stop();
+}
+
+void DeviceSession::log_prefix(const nlohmann::json& config)
+{
+    log_prefix_ = "[" + config["measurement"]["device"].value("serial", "") + "] ";
+}
+
+void DeviceSession::on_source_config(const nlohmann::json& config)
+{
+    // Back in the config
+    if (retired_)
+    {
+        retired_ = false;
+        stop_requested_ = false;
+        // The recording is stopping already, the restart has to set up the new config
+        if (device_state_ == DeviceState::recording)
+        {
+            pending_change_ = ConfigChange::full;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    auto change = diff(config_, config);
+    config_ = config;
+    log_prefix(config_);
+    if (device_state_ == DeviceState::recording)
+    {
+        if (pending_change_ != ConfigChange::none)
+        {
+            // The recording is already stopping, we only need to make sure, the restart does
+            // enough
+            pending_change_ = std::max(pending_change_, change);
+            Log::info() << log_prefix_ << "Received new config while stopping the recording.";
+        }
+        else if (change == ConfigChange::none)
+        {
+            Log::info() << log_prefix_ << "Received unchanged config.";
+        }
+        else if (change == ConfigChange::host)
+        {
+            // Names and chunk sizes only concern the metrics, the recording just goes on
+            Log::info() << log_prefix_ << "Received new config. Updating metrics.";
+            device_->rename_channels(config_);
+            source_.rebuild_metrics();
+        }
+        else
+        {
+            Log::info() << log_prefix_ << "Received new config. Restarting requested.";
+            pending_change_ = change;
+            stop_recording();
+        }
+    }
+    else if (device_state_ == DeviceState::setup)
+    {
+        Log::info() << log_prefix_ << "Received new config during setup. Restarting requested.";
+        restart_requested_ = true;
+    }
+    else if (device_state_ == DeviceState::none && !stop_requested_)
+    {
+        // Don't wait for the rest of the MetricQ handshake, setting up the device takes longer.
+        // Until the source is ready, the frames stay queued.
+        Log::info() << log_prefix_ << "Received config. Setting up the device.";
+        device_state_ = DeviceState::setup;
+        // unlock first, setup_device takes the lock again
+        asio::post(io_service_, [this]() { this->setup_device(); });
+    }
+}
+
+DeviceSession::~DeviceSession()
+{
+    // The device thread must not wait for room anymore, nobody drains the queue
+    stop_requested_ = true;
+    wake_producer();
+
+    try
+    {
+        device_thread_.run([this]() { device_.reset(); });
+    }
+    catch (std::exception& e)
+    {
+        Log::error() << log_prefix_ << "Failed to stop the device: " << e.what();
+    }
+}
+
+void DeviceSession::stop_recording()
+{
+    device_thread_.post([this]() {
+        // not recording, if resuming the recording failed
+        if (device_ && device_->recording())
+        {
+            device_->stop_recording();
+        }
+    });
+}
+
+void DeviceSession::setup_device()
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+
+    // The stats metrics refer to the old device and will be cleared below
+    stats_.clear();
+
+    device_state_ = DeviceState::setup;
+    metrics_active_ = false;
+
+    // The setup of the device takes a while, so it runs on the device thread and the MetricQ
+    // thread stays responsive in the meantime.
+    device_thread_.post([this, config = config_]() {
+        // When handling a reconfigure, before creating a new device, we need to make sure, the old
+        // one is gone. So yes, this explicit reset is intentional.
+        device_.reset(nullptr);
+        if (!this->try_take_over(config))
+        {
+            device_ = std::make_unique<lmgd::device::Device>(device_thread_.io_service(), config);
+        }
+
+        asio::post(io_service_, [this]() { this->on_device_ready(); });
+    });
+}
+
+void DeviceSession::update_device()
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+
+    device_state_ = DeviceState::setup;
+    // The device thread renames the tracks
+    metrics_active_ = false;
+
+    // Keep the device and the connection, only send what changed
+    device_thread_.post([this, config = config_]() {
+        device_->rename_channels(config);
+        device_->update_ranges(config);
+
+        asio::post(io_service_, [this]() { this->on_device_ready(); });
+    });
+}
+
+void DeviceSession::on_device_ready()
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+
+    assert(device_state_ == DeviceState::setup);
+
+    if (stop_requested_)
+    {
+        Log::info() << log_prefix_ << "Device setup finished after shutdown was requested. Stop.";
+        device_state_ = DeviceState::none;
+        source_.session_stopped();
+        return;
+    }
+
+    if (restart_requested_)
+    {
+        restart_requested_ = false;
+        // unlock first, setup_device takes the lock again
+        asio::post(io_service_, [this]() { this->setup_device(); });
+        return;
+    }
+
+    if (disconnected_since_)
+    {
+        std::chrono::duration<double> disconnected =
+            std::chrono::steady_clock::now() - *disconnected_since_;
+        disconnected_since_.reset();
+        reconnect_attempts_ = 0;
+
+        disconnected_time_ += disconnected.count();
+        lost_samples_ += disconnected.count() * device_->sampling_rate() *
+                         device_->get_tracks().size();
+
+        Log::info() << log_prefix_ << "Reconnected to the device after " << disconnected.count()
+                    << " s";
+    }
+
+    // Go on, where the other process stopped, if any
+    metric_states_ = std::move(taken_over_metrics_);
+    taken_over_metrics_ = nullptr;
+    metrics_active_ = true;
+    source_.rebuild_metrics();
+
+    start_watchdog();
+
+    device_thread_.post([this]() { this->start_stream(); });
+
+    device_state_ = DeviceState::recording;
+
+    listen_for_handover();
+}
+
+void DeviceSession::start_watchdog()
+{
+    // Waiting for 10 frames is enough to notice a dead connection, but the timer isn't precise
+    // enough for fast sampling rates.
+    auto stream_timeout = config_["measurement"]["device"].value(
+        "stream_timeout", std::max(2., 10 * device_->frame_interval()));
+
+    timer_.start(
+        [this, stream_timeout](auto) {
+            Log::error() << log_prefix_ << "LMG failed to send values within the last "
+                         << stream_timeout << " seconds. Assuming the connection died.";
+            this->disconnect();
+            return metricq::Timer::TimerResult::cancel;
+        },
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>(stream_timeout)));
+}
+
+void DeviceSession::start_stream()
+{
+    recording_started_ = std::chrono::steady_clock::now();
+    last_frame_ = {};
+    // A recording taken over from another process is running already
+    if (!device_->recording())
+    {
+        device_->start_recording(device_->data_format());
+    }
+
+    if (device_->data_format() == network::Connection::Mode::ascii)
+    {
+        device_->fetch_data([this](auto line) { return this->on_ascii_line(line); });
+    }
+    else
+    {
+        device_->fetch_binary_data([this](auto& data) { return this->on_binary_frame(data); });
+    }
+}
+
+bool DeviceSession::try_take_over(const nlohmann::json& config)
+{
+    if (!take_over_)
+    {
+        return false;
+    }
+    take_over_ = false;
+
+    const auto& device_config = config.at("measurement").at("device");
+    auto path = device_config.value("handover", "");
+    if (path.empty())
+    {
+        return false;
+    }
+
+    try
+    {
+        // The other process waits for the next frame, before it answers
+        auto timeout = device_config.value("handover_timeout", 10.);
+        auto taken_over = take_over(path, config,
+                                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        std::chrono::duration<double>(timeout)));
+        if (!taken_over)
+        {
+            return false;
+        }
+
+        device_ = std::make_unique<lmgd::device::Device>(
+            device_thread_.io_service(), config, std::move(taken_over->device));
+        taken_over_metrics_ = std::move(taken_over->metrics);
+        return true;
+    }
+    catch (std::exception& e)
+    {
+        Log::error() << log_prefix_
+                     << "Failed to take over the recording, setting up the device instead: "
+                     << e.what();
+        return false;
+    }
+}
+
+void DeviceSession::resume_recording()
+{
+    // Everything on our side stays as it is, including the state of the metrics, so there is only
+    // a short gap in the data.
+    start_watchdog();
+
+    device_thread_.post([this]() {
+        try
+        {
+            device_->reset_stream();
+            this->start_stream();
+        }
+        catch (std::exception& e)
+        {
+            Log::warn() << log_prefix_ << "Failed to resume the recording: " << e.what();
+            asio::post(io_service_, [this]() { this->disconnect(); });
+        }
+    });
+
+    device_state_ = DeviceState::recording;
+}
+
+void DeviceSession::on_device_error(std::exception_ptr error)
+{
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (std::exception& e)
+    {
+        Log::error() << log_prefix_ << "Lost the device: " << e.what();
+    }
+
+    disconnect();
+}
+
+void DeviceSession::disconnect()
+{
+    if (device_state_ == DeviceState::reconnecting)
+    {
+        return;
+    }
+
+    timer_.cancel();
+    device_state_ = DeviceState::reconnecting;
+    metrics_active_ = false;
+    pending_change_ = ConfigChange::none;
+    decline_handover("Lost the device");
+    restart_requested_ = false;
+
+    if (!disconnected_since_)
+    {
+        disconnected_since_ = std::chrono::steady_clock::now();
+    }
+
+    // The stats metrics refer to the device
+    stats_.clear();
+
+    device_thread_.post([this]() {
+        if (device_)
+        {
+            device_->abort();
+        }
+
+        // The handlers of the aborted operations are already queued, so they run before this one
+        device_thread_.post([this]() {
+            device_.reset();
+            asio::post(io_service_, [this]() { this->schedule_reconnect(); });
+        });
+    });
+}
+
+void DeviceSession::schedule_reconnect()
+{
+    if (stop_requested_)
+    {
+        device_state_ = DeviceState::none;
+        source_.session_stopped();
+        return;
+    }
+
+    const auto& device_config = config_["measurement"]["device"];
+    auto min_delay = device_config.value("reconnect_delay", 1.);
+    auto max_delay = device_config.value("reconnect_delay_max", 60.);
+
+    // Exponential backoff, but with a random part, so several instances of lmgd don't hammer a
+    // shared network or a restarting device in lockstep
+    auto delay = std::min(max_delay, min_delay * std::pow(2., reconnect_attempts_++));
+    delay = std::uniform_real_distribution<double>(delay / 2, delay)(random_);
+
+    Log::info() << log_prefix_ << "Reconnecting to the device in " << delay << " s (attempt "
+                << reconnect_attempts_ << ")";
+
+    reconnect_timer_.expires_after(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::duration<double>(delay)));
+    reconnect_timer_.async_wait([this](auto error) {
+        if (error || stop_requested_)
+        {
+            return;
+        }
+
+        ++reconnects_;
+        this->setup_device();
+    });
+}
+
+void DeviceSession::listen_for_handover()
+{
+    auto path = config_["measurement"]["device"].value("handover", "");
+    if (path.empty() || handover_listener_)
+    {
+        return;
+    }
+
+    try
+    {
+        handover_listener_ = std::make_unique<HandoverListener>(
+            io_service_, path, [this](auto request) { this->on_handover_request(request); });
+    }
+    catch (std::exception& e)
+    {
+        Log::warn() << log_prefix_
+                    << "Can't hand over the recording to other processes: " << e.what();
+    }
+}
+
+void DeviceSession::on_handover_request(std::shared_ptr<HandoverRequest> request)
+{
+    if (handover_)
+    {
+        request->decline("Another process is taking over already");
+        return;
+    }
+
+    if (device_state_ != DeviceState::recording || pending_change_ != ConfigChange::none ||
+        stop_requested_)
+    {
+        request->decline("Not recording right now");
+        return;
+    }
+
+    if (config_["measurement"]["device"].value("format", "binary") != "binary")
+    {
+        request->decline("Only recordings in the binary data format can be handed over");
+        return;
+    }
+
+    // Different names or chunk sizes are fine, the recording itself must stay the same
+    try
+    {
+        if (diff(config_, request->config()) > ConfigChange::host)
+        {
+            request->decline("The config of the other process differs");
+            return;
+        }
+    }
+    catch (std::exception& e)
+    {
+        request->decline(std::string("Invalid config: ") + e.what());
+        return;
+    }
+
+    Log::info() << log_prefix_ << "Handing over the recording at the next frame";
+
+    // Make room for the listener of the other process
+    handover_listener_.reset();
+    handover_ = std::move(request);
+    handover_requested_ = true;
+    wake_producer();
+}
+
+void DeviceSession::decline_handover(const std::string& reason)
+{
+    handover_requested_ = false;
+    if (handover_)
+    {
+        handover_->decline(reason);
+        handover_.reset();
+    }
+}
+
+void DeviceSession::hand_over()
+{
+    timer_.cancel();
+    handover_requested_ = false;
+    stop_requested_ = true;
+    device_state_ = DeviceState::handing_over;
+    metrics_active_ = false;
+
+    // Publish everything up to the frame boundary, the other process goes on from there
+    nlohmann::json metrics = nlohmann::json::object();
+    for (auto& metric : lmg_metrics_)
+    {
+        metric.finish();
+        metrics[metric.name()] = metric.state();
+    }
+    for (auto& offset_metric : offset_metrics_)
+    {
+        offset_metric.local_offset.flush();
+        offset_metric.chunk_offset.flush();
+    }
+
+    // The stats metrics refer to the device
+    stats_.clear();
+
+    device_thread_.post([this, request = std::move(handover_), metrics = std::move(metrics)]() {
+        try
+        {
+            request->accept(device_->hand_over(), metrics);
+            Log::info() << log_prefix_ << "Handed over the recording";
+        }
+        catch (std::exception& e)
+        {
+            Log::error() << log_prefix_ << "Failed to hand over the recording: " << e.what();
+        }
+        device_.reset();
+
+        asio::post(io_service_, [this]() {
+            device_state_ = DeviceState::none;
+            source_.session_stopped();
+        });
+    });
+}
+
+void DeviceSession::release_metrics()
+{
+    // The stats metrics go away as well
+    stats_.clear();
+
+    // Don't lose what is still buffered, and go on from there, unless the recording starts over
+    const bool keep_state = metrics_active_ && device_state_ == DeviceState::recording;
+    for (auto& metric : lmg_metrics_)
+    {
+        metric.flush();
+        if (keep_state)
+        {
+            metric_states_[metric.name()] = metric.state();
+        }
+    }
+
+    lmg_metrics_.clear();
+    offset_metrics_.clear();
+    flush_wheel_.clear();
+}
+
+void DeviceSession::setup_metrics()
+{
+    if (!metrics_active_)
+    {
+        return;
+    }
+
+    auto queue = queue_settings(config_);
+    queue_policy_ = queue.policy;
+    decimation_ = queue.decimation;
+    // The frames are processed without touching the device, which might be gone already
+    measurement_mode_ = device_->measurement_mode();
+
+    // The device thread is idle until the recording starts, and only the tracks are read
+    // afterwards, so accessing the device is fine.
+    auto policies = compression::policies(config_, *device_);
+    auto policy = policies.begin();
+    auto flush_policies = source::flush_policies(config_, *device_);
+    auto flush_policy = flush_policies.begin();
+
+    assert(lmg_metrics_.empty());
+    flush_wheel_.tick(flush_tick(flush_policies));
+
+    for (auto& track : device_->get_tracks())
+    {
+        auto& source_metric = source_[track.name()];
+        source_metric.metadata.rate(device_->sampling_rate());
+        Log::info() << log_prefix_ << "Add metric to recording: " << track.name();
+        lmg_metrics_.emplace_back(track, source_metric, source_, *flush_policy++, *policy++);
+        if (device_->measurement_mode() == device::MeasurementMode::gapless)
+        {
+            source_metric.metadata.chunk_size(device_->gap_length());
+
+            offset_metrics_.emplace_back(source_, track.name());
+            offset_metrics_.back().local_offset.metadata.rate(
+                device_->sampling_rate() / device_->gap_length());
+            offset_metrics_.back().chunk_offset.metadata.rate(
+                device_->sampling_rate() / device_->gap_length());
+        }
+    }
+
+    stats_.prefix(config_["measurement"]["device"].value(
+        "stats_prefix",
+        "lmgd." + config_["measurement"]["device"]["serial"].get<std::string>()));
+    stats_.add("resyncs", "", [this]() { return device_->resync_stats().resyncs.load(); });
+    stats_.add("lost_bytes", "B", [this]() { return device_->resync_stats().lost_bytes.load(); });
+    stats_.add("damaged_frames", "", [this]() { return damaged_frames_.load(); });
+    stats_.add("dropped_frames", "", [this]() { return dropped_frames_.load(); });
+    stats_.add("degraded_frames", "", [this]() { return degraded_frames_; });
+    stats_.add("queue_depth", "", [this]() { return frames_.size(); });
+    stats_.add("queue_high_water_mark", "", [this]() { return frames_.high_water_mark(); });
+    stats_.add("reconnects", "", [this]() { return reconnects_; });
+    stats_.add("disconnected_time", "s", [this]() { return disconnected_time_; });
+    stats_.add("lost_samples", "", [this]() { return lost_samples_; });
+    stats_.add("frame_interval_max", "s", [this]() {
+        return frame_interval_max_.exchange(0) * 1e-6;
+    });
+
+    // Samples passed to the policy per published sample, since the stats were published last
+    std::set<std::string> compressions;
+    for (const auto& metric : lmg_metrics_)
+    {
+        compressions.insert(metric.compression());
+    }
+    for (const auto& compression : compressions)
+    {
+        stats_.add(
+            "compression." + compression,
+            "",
+            [this, compression, in = std::uint64_t(0), out = std::uint64_t(0)]() mutable {
+                auto last_in = in;
+                auto last_out = out;
+                in = out = 0;
+                for (const auto& metric : lmg_metrics_)
+                {
+                    if (metric.compression() == compression)
+                    {
+                        in += metric.samples_in();
+                        out += metric.samples_out();
+                    }
+                }
+                auto published = std::max<std::uint64_t>(out - last_out, 1);
+                return static_cast<double>(in - last_in) / published;
+            });
+    }
+
+    // Go on, where the last metrics stopped
+    if (!metric_states_.is_null())
+    {
+        for (auto& metric : lmg_metrics_)
+        {
+            auto state = metric_states_.find(metric.name());
+            if (state != metric_states_.end())
+            {
+                metric.restore(*state);
+            }
+        }
+        metric_states_ = nullptr;
+    }
+
+    if (source_.source_ready())
+    {
+        stats_.start();
+    }
+}
+
+network::CallbackResult DeviceSession::on_binary_frame(std::shared_ptr<network::BinaryData>& data)
+{
+    Log::trace() << log_prefix_ << "Called completion_callback: " << data->size();
+
+    track_latency();
+
+    // The first frames warm up the frame pool and the queue. Afterwards, no heap allocations should
+    // happen in between two frames.
+    auto allocations = alloc_tracker_.tick();
+    if (++frame_count_ > 100 && allocations > 0)
+    {
+        Log::debug() << log_prefix_ << "Heap allocations since the previous frame: " << allocations;
+    }
+
+    if (data->size() == 1)
+    {
+        char c = data->read_char();
+        if (c != '1')
+        {
+            Log::error() << log_prefix_ << "Unexpected single char '" << c << "' ("
+                         << static_cast<int>(c) << ")";
+        }
+
+        return end_stream();
+    }
+
+    if (drop_data_)
+    {
+        return next_frame();
+    }
+
+    if (!device_->check_frame(*data))
+    {
+        Log::warn() << log_prefix_ << "Dropping damaged frame of " << data->size() << " bytes";
+        ++damaged_frames_;
+        return next_frame();
+    }
+
+    auto frame = prepare_frame();
+    if (!frame)
+    {
+        return next_frame();
+    }
+
+    frame->type = QueuedFrame::Type::binary;
+    frame->time = metricq::Clock::now();
+    frame->data = data;
+    frames_.commit();
+    notify();
+
+    return next_frame();
+}
+
+network::CallbackResult DeviceSession::on_ascii_line(std::string_view line)
+{
+    Log::trace() << log_prefix_ << "Called on_ascii_line: " << line.size();
+
+    track_latency();
+
+    // The answer to the *opc? sent by Device::stop_recording
+    if (!device_->recording() && line == "1")
+    {
+        return end_stream();
+    }
+
+    if (drop_data_)
+    {
+        return network::CallbackResult::repeat;
+    }
+
+    auto frame = prepare_frame();
+    if (!frame)
+    {
+        return network::CallbackResult::repeat;
+    }
+
+    // The answers to the queries of the trigger action are separated by ';', a single answer may
+    // consist of several comma-separated values. Either way, we get one value per track.
+    frame->type = QueuedFrame::Type::ascii;
+    frame->time = metricq::Clock::now();
+    frame->values.resize(device_->get_tracks().size());
+
+    auto it = line.data();
+    auto end = line.data() + line.size();
+
+    for (auto& value : frame->values)
+    {
+        while (it != end && (*it == ';' || *it == ',' || *it == ' '))
+        {
+            ++it;
+        }
+
+        auto [next, ec] = std::from_chars(it, end, value);
+        if (ec != std::errc())
+        {
+            Log::error() << log_prefix_ << "Failed to parse values from line: " << line;
+            return network::CallbackResult::repeat;
+        }
+        it = next;
+    }
+
+    frames_.commit();
+    notify();
+
+    return network::CallbackResult::repeat;
+}
+
+network::CallbackResult DeviceSession::next_frame()
+{
+    // Stop at this frame boundary, the rest of the stream goes to the other process
+    if (handover_requested_)
+    {
+        return end_stream(QueuedFrame::Type::handover);
+    }
+
+    return network::CallbackResult::repeat;
+}
+
+QueuedFrame* DeviceSession::prepare_frame()
+{
+    auto frame = frames_.prepare(end_of_stream_slots);
+    if (!frame)
+    {
+        auto policy = queue_policy_.load();
+        if (policy == QueuePolicy::drop_newest)
+        {
+            if (dropped_frames_++ == 0)
+            {
+                Log::warn() << log_prefix_ << "Frame queue is full, dropping frames";
+            }
+            frames_lost_ = true;
+            // keeps the watchdog quiet, while the frames are held back until MetricQ is ready
+            notify();
+            return nullptr;
+        }
+
+        // Unless blocking, the MetricQ thread drops the oldest frames to make room
+        overflow_ = policy != QueuePolicy::block;
+        notify();
+
+        frame = wait_for_room();
+        if (!frame)
+        {
+            frames_lost_ = true;
+            return nullptr;
+        }
+    }
+
+    frame->gap = std::exchange(frames_lost_, false);
+    return frame;
+}
+
+QueuedFrame* DeviceSession::wait_for_room()
+{
+    std::unique_lock<std::mutex> lock(room_mutex_);
+    waiting_for_room_.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in wake_producer(): either we see the room or the request, or the
+    // MetricQ thread sees us waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    QueuedFrame* frame = nullptr;
+    // On stop or handover, the MetricQ thread may not make room anymore, e.g., before the source
+    // is ready. Then the frame is dropped.
+    room_available_.wait(lock, [this, &frame]() {
+        frame = frames_.prepare(end_of_stream_slots);
+        return frame || stop_requested_ || handover_requested_;
+    });
+
+    waiting_for_room_.store(false, std::memory_order_relaxed);
+    return frame;
+}
+
+void DeviceSession::wake_producer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_for_room_.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(room_mutex_);
+        room_available_.notify_one();
+    }
+}
+
+network::CallbackResult DeviceSession::end_stream(QueuedFrame::Type type)
+{
+    // The end of the stream must not get lost, the frames leave a slot for it.
+    auto frame = frames_.prepare();
+    assert(frame);
+
+    frame->type = type;
+    frames_.commit();
+    notify();
+
+    return network::CallbackResult::cancel;
+}
+
+void DeviceSession::notify()
+{
+    // Only one drain is in flight at a time, it takes up to a full queue of frames.
+    if (!drain_scheduled_.exchange(true))
+    {
+        asio::post(io_service_, [this]() { this->drain(); });
+    }
+}
+
+void DeviceSession::track_latency()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (last_frame_ == std::chrono::steady_clock::time_point())
+    {
+        Log::info() << log_prefix_ << "First frame arrived "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                                             recording_started_)
+                           .count()
+                    << " ms after the start of the recording";
+    }
+    else
+    {
+        auto interval =
+            std::chrono::duration_cast<std::chrono::microseconds>(now - last_frame_).count();
+        Log::trace() << log_prefix_ << "Frame interval: " << interval << " us";
+
+        // We are the only writer, the stats only reset it to zero
+        std::uint64_t max = frame_interval_max_.load();
+        while (static_cast<std::uint64_t>(interval) > max &&
+               !frame_interval_max_.compare_exchange_weak(max, interval))
+        {
+        }
+    }
+
+    last_frame_ = now;
+}
+
+void DeviceSession::drain()
+{
+    drain_scheduled_ = false;
+
+    // Even before the source is ready, the device thread must not wait for that
+    drop_oldest_frames();
+
+    // Before the source is ready, we can't publish anything yet. The frames stay queued, unless
+    // the recording is about to go away anyway.
+    const bool source_ready = source_.source_ready();
+    bool discard = !source_ready && (stop_requested_ || pending_change_ != ConfigChange::none);
+    if (!source_ready && !discard)
+    {
+        if (!frames_.empty())
+        {
+            timer_.restart();
+        }
+        return;
+    }
+
+    std::size_t processed = 0;
+    while (auto frame = frames_.front())
+    {
+        // If publishing can't keep up, the queue never runs empty. Let other handlers, e.g., the
+        // signal handler or new configs, run in between.
+        if (processed++ == frames_.capacity())
+        {
+            notify();
+            return;
+        }
+
+        timer_.restart();
+
+        switch (frame->type)
+        {
+        case QueuedFrame::Type::binary:
+            // No metrics, if another session rebuilt them, while this device is gone
+            if (!discard && !lmg_metrics_.empty())
+            {
+                auto gap = std::exchange(gap_, false) || frame->gap;
+                process_frame(*frame->data, frame->time, gap, degraded());
+            }
+            // Hand the buffer back to the frame pool
+            frame->data.reset();
+            break;
+        case QueuedFrame::Type::ascii:
+            if (!discard && !lmg_metrics_.empty())
+            {
+                process_values(frame->time, frame->values, degraded());
+            }
+            break;
+        case QueuedFrame::Type::end_of_stream:
+            frames_.pop();
+            on_end_of_stream();
+            return;
+        case QueuedFrame::Type::handover:
+            frames_.pop();
+            // unless declined in the meantime, e.g., after losing the device
+            if (handover_)
+            {
+                hand_over();
+            }
+            return;
+        }
+
+        frames_.pop();
+        wake_producer();
+        drop_oldest_frames();
+    }
+}
+
+void DeviceSession::drop_oldest_frames()
+{
+    if (!overflow_.load(std::memory_order_relaxed) || !overflow_.exchange(false))
+    {
+        return;
+    }
+
+    // Half the queue, so the device thread doesn't come back right away
+    while (frames_.size() > frames_.capacity() / 2)
+    {
+        auto frame = frames_.front();
+        // The end of the stream must not get lost
+        if (frame->type != QueuedFrame::Type::binary && frame->type != QueuedFrame::Type::ascii)
+        {
+            break;
+        }
+
+        if (dropped_frames_++ == 0)
+        {
+            Log::warn() << log_prefix_ << "Frame queue is full, dropping the oldest frames";
+        }
+        frame->data.reset();
+        frames_.pop();
+        gap_ = true;
+    }
+    wake_producer();
+}
+
+bool DeviceSession::degraded()
+{
+    if (queue_policy_.load() != QueuePolicy::decimate)
+    {
+        degraded_ = false;
+        return false;
+    }
+
+    // Some hysteresis, so it doesn't flip with every frame
+    auto depth = frames_.size();
+    if (!degraded_ && depth >= frames_.capacity() * 3 / 4)
+    {
+        Log::warn() << log_prefix_ << "Frame queue is backed up, decimating the published data";
+        degraded_ = true;
+    }
+    else if (degraded_ && depth <= frames_.capacity() / 4)
+    {
+        Log::info() << log_prefix_ << "Frame queue caught up, publishing all data again";
+        degraded_ = false;
+    }
+
+    if (degraded_)
+    {
+        ++degraded_frames_;
+    }
+    return degraded_;
+}
+
+bool DeviceSession::skip_degraded()
+{
+    // Only every decimation_-th frame of the degraded ones goes out
+    return degraded_frames_ % decimation_ != 0;
+}
+
+void DeviceSession::process_frame(
+    network::BinaryData& data,
+    metricq::TimePoint time,
+    bool gap,
+    bool degraded)
+{
+    if (measurement_mode_ == device::MeasurementMode::gapless)
+    {
+        auto& frame = gapless_frame_;
+        frame.parse(data, lmg_metrics_.size());
+        const auto base_cycle_start = frame.cycle_start();
+        const auto cycle_duration = frame.cycle_duration();
+
+        auto it = offset_metrics_.begin();
+
+        for (std::size_t index = 0; index < lmg_metrics_.size(); index++)
+        {
+            auto& metric = lmg_metrics_[index];
+            if (gap)
+            {
+                metric.restart_cycle();
+            }
+            const auto cycle_start = metric.cycle_start(base_cycle_start);
+
+            assert(it != offset_metrics_.end());
+            auto& offset_metric = *it++;
+
+            offset_metric.local_offset.send({
+                metricq::TimePoint(cycle_start.time_since_epoch()),
+                std::chrono::duration_cast<std::chrono::duration<double>>(
+                    metricq::Clock::now().time_since_epoch() - cycle_start.time_since_epoch())
+                    .count(),
+            });
+
+            offset_metric.chunk_offset.send({
+                metricq::TimePoint(cycle_start.time_since_epoch()),
+                std::chrono::duration_cast<std::chrono::duration<double>>(base_cycle_start -
+                                                                          cycle_start)
+                    .count(),
+            });
+
+            const auto list = frame.track(index);
+
+            const auto& times = frame_times_.get(cycle_start, cycle_duration, list.size());
+
+            if (degraded)
+            {
+                decimate(times, list);
+                metric.send(
+                    decimated_times_.data(), decimated_values_.data(), decimated_values_.size());
+            }
+            else
+            {
+                metric.send(times, list);
+            }
+            end_frame(index);
+            metric.cycle_end(cycle_start + cycle_duration);
+        }
+    }
+    else
+    {
+        if (degraded && skip_degraded())
+        {
+            return;
+        }
+
+        for (std::size_t index = 0; index < lmg_metrics_.size(); index++)
+        {
+            lmg_metrics_[index].send(time, data.read_float());
+            end_frame(index);
+        }
+    }
+}
+
+void DeviceSession::process_values(
+    metricq::TimePoint time,
+    const std::vector<float>& values,
+    bool degraded)
+{
+    assert(values.size() == lmg_metrics_.size());
+
+    if (degraded && skip_degraded())
+    {
+        return;
+    }
+
+    for (auto value : nitro::lang::enumerate(values))
+    {
+        lmg_metrics_[value.index()].send(time, value.value());
+        end_frame(value.index());
+    }
+}
+
+void DeviceSession::end_frame(std::size_t index)
+{
+    auto& metric = lmg_metrics_[index];
+
+    if (metric.flush_policy().every_frame())
+    {
+        metric.flush();
+    }
+    else if (auto deadline = metric.take_deadline())
+    {
+        flush_wheel_.schedule(index, *deadline);
+    }
+}
+
+void DeviceSession::on_flush_due(std::size_t index)
+{
+    // The wheel may be up to a tick early. The metric might have been flushed since by its
+    // max_size or be gone with a reconfigure, then the entry is stale.
+    if (index < lmg_metrics_.size())
+    {
+        lmg_metrics_[index].flush_if_due(TimerWheel::Clock::now() + flush_wheel_.tick());
+    }
+}
+
+void DeviceSession::decimate(const std::vector<time::TimePoint>& times, Span<const float> values)
+{
+    const std::size_t factor = decimation_;
+
+    decimated_times_.clear();
+    decimated_values_.clear();
+
+    for (std::size_t begin = 0; begin < values.size(); begin += factor)
+    {
+        auto end = std::min(values.size(), begin + factor);
+
+        double sum = 0;
+        for (auto i = begin; i < end; i++)
+        {
+            sum += values[i];
+        }
+
+        // Like any sample, the mean covers the time up to its timestamp
+        decimated_times_.push_back(times[end - 1]);
+        decimated_values_.push_back(sum / (end - begin));
+    }
+}
+
+void DeviceSession::on_end_of_stream()
+{
+    timer_.cancel();
+    device_state_ = DeviceState::none;
+    decline_handover("The recording stopped");
+
+    // The samples held back by the compression don't wait for the next recording
+    for (auto& metric : lmg_metrics_)
+    {
+        metric.finish();
+    }
+
+    if (stop_requested_)
+    {
+        Log::info() << log_prefix_ << "Datastream from device ended. Stop.";
+        source_.session_stopped();
+    }
+    else if (pending_change_ == ConfigChange::ranges)
+    {
+        Log::info() << log_prefix_ << "Datastream from device ended. Updating ranges...";
+        update_device();
+    }
+    else if (pending_change_ == ConfigChange::full)
+    {
+        Log::info() << log_prefix_ << "Datastream from device ended. Restarting...";
+        setup_device();
+    }
+    else
+    {
+        Log::info() << log_prefix_ << "Datastream from device ended unexpectedly. Resuming...";
+        resume_recording();
+    }
+
+    pending_change_ = ConfigChange::none;
+}
+
+void DeviceSession::on_source_ready()
+{
+    if (device_state_ == DeviceState::none && !stop_requested_)
+    {
+        setup_device();
+    }
+    else if (device_state_ == DeviceState::recording)
+    {
+        // The device was faster than the handshake, the Source declares the metrics
+        Log::info() << log_prefix_ << "Publishing " << frames_.size()
+                    << " frames recorded before MetricQ was ready";
+        stats_.start();
+        notify();
+    }
+    // otherwise, on_device_ready will declare the metrics
+}
+
+void DeviceSession::on_connection_lost()
+{
+    if (device_state_ != DeviceState::none)
+    {
+        stop_requested_ = true;
+        wake_producer();
+    }
+    // A pending handover goes on, the other process takes over the recording
+    if (device_state_ == DeviceState::recording && !handover_)
+    {
+        stop_recording();
+    }
+    reconnect_timer_.cancel();
+    flush_wheel_.clear();
+}
+
+} // namespace lmgd::source
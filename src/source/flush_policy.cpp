@@ -0,0 +1,81 @@
+#include <lmgd/source/flush_policy.hpp>
+
+#include <lmgd/source/track_settings.hpp>
+
+#include <lmgd/except.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace lmgd::source
+{
+namespace
+{
+    FlushPolicy parse(const nlohmann::json& config)
+    {
+        FlushPolicy policy;
+
+        auto max_size = config.value("max_size", std::int64_t(0));
+        if (max_size < 0)
+        {
+            raise("The max_size of a flush policy must not be negative");
+        }
+        policy.max_size = static_cast<std::size_t>(max_size);
+
+        if (config.count("max_age"))
+        {
+            auto max_age = config["max_age"].get<double>();
+            if (!(max_age > 0))
+            {
+                raise("The max_age of a flush policy must be positive");
+            }
+            policy.max_age = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::duration<double>(max_age));
+        }
+
+        return policy;
+    }
+} // namespace
+
+std::vector<FlushPolicy> flush_policies(const nlohmann::json& config, const device::Device& device)
+{
+    const auto mode = device.measurement_mode();
+    check_track_settings(config, "flush", mode);
+
+    nlohmann::json fallback = { { "max_size", config.value("chunk_size", 0) } };
+    if (config.count("flush"))
+    {
+        fallback = config["flush"];
+    }
+
+    std::vector<FlushPolicy> result;
+
+    for (const auto& track : device.get_tracks())
+    {
+        try
+        {
+            result.push_back(parse(track_setting(config, "flush", track, mode, fallback)));
+        }
+        catch (std::exception& e)
+        {
+            raise("Invalid flush policy for ", track.name(), ": ", e.what());
+        }
+    }
+
+    return result;
+}
+
+std::chrono::nanoseconds flush_tick(const std::vector<FlushPolicy>& policies)
+{
+    std::chrono::nanoseconds tick = std::chrono::milliseconds(10);
+    for (const auto& policy : policies)
+    {
+        if (policy.max_age)
+        {
+            tick = std::min(tick, *policy.max_age / 10);
+        }
+    }
+    return std::max<std::chrono::nanoseconds>(tick, std::chrono::milliseconds(1));
+}
+} // namespace lmgd::source
@@ -0,0 +1,419 @@
+#include <lmgd/source/handover.hpp>
+
+#include <lmgd/except.hpp>
+#include <lmgd/log.hpp>
+
+#include <asio/error.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+namespace lmgd::source
+{
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr std::chrono::seconds send_timeout{ 5 };
+
+    // Anything larger isn't a message of ours
+    constexpr std::uint32_t max_message_size = 16 * 1024 * 1024;
+
+    void wait(int socket, short events, Clock::time_point deadline)
+    {
+        auto remaining =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+
+        pollfd pfd{ socket, events, 0 };
+        int result;
+        do
+        {
+            result = ::poll(&pfd, 1, std::max<int>(0, remaining.count()));
+        } while (result < 0 && errno == EINTR);
+
+        if (result < 0)
+        {
+            raise("Failed to wait for the handover socket: ", std::strerror(errno));
+        }
+        if (result == 0)
+        {
+            throw TimeoutError("The other process didn't answer in time");
+        }
+    }
+
+    // Sends everything, a file descriptor goes along with the first byte
+    void send(int socket, const std::string& data, int fd, Clock::time_point deadline)
+    {
+        std::size_t sent = 0;
+
+        while (sent < data.size())
+        {
+            iovec iov{ const_cast<char*>(data.data()) + sent, data.size() - sent };
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+            if (fd >= 0 && sent == 0)
+            {
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+
+                auto cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+                std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+            }
+
+            auto result = ::sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (result < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    wait(socket, POLLOUT, deadline);
+                    continue;
+                }
+                raise("Failed to send on the handover socket: ", std::strerror(errno));
+            }
+
+            sent += result;
+        }
+    }
+
+    // Receives exactly size bytes. A file descriptor passed along ends up in fd.
+    void receive(int socket, void* data, std::size_t size, int& fd, Clock::time_point deadline)
+    {
+        std::size_t received = 0;
+
+        while (received < size)
+        {
+            iovec iov{ static_cast<char*>(data) + received, size - received };
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            auto result = ::recvmsg(socket, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+            if (result < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    wait(socket, POLLIN, deadline);
+                    continue;
+                }
+                raise("Failed to receive on the handover socket: ", std::strerror(errno));
+            }
+            if (result == 0)
+            {
+                raise("The other process closed the handover socket");
+            }
+
+            for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                {
+                    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+                }
+            }
+
+            received += result;
+        }
+    }
+
+    std::string with_size(const void* data, std::uint32_t size)
+    {
+        std::string result(reinterpret_cast<const char*>(&size), sizeof(size));
+        result.append(static_cast<const char*>(data), size);
+        return result;
+    }
+
+    std::string message(const nlohmann::json& data)
+    {
+        auto text = data.dump();
+        return with_size(text.data(), text.size());
+    }
+
+    std::uint32_t receive_size(int socket, int& fd, Clock::time_point deadline)
+    {
+        std::uint32_t size;
+        receive(socket, &size, sizeof(size), fd, deadline);
+
+        if (size > max_message_size)
+        {
+            raise("Invalid message size on the handover socket: ", size);
+        }
+        return size;
+    }
+
+    nlohmann::json receive_message(int socket, int& fd, Clock::time_point deadline)
+    {
+        std::string text(receive_size(socket, fd, deadline), '\0');
+        receive(socket, text.data(), text.size(), fd, deadline);
+        return nlohmann::json::parse(text);
+    }
+
+    // Any invalid uid, if the credentials are unknown
+    uid_t peer_uid(int socket)
+    {
+        ucred credentials{};
+        socklen_t size = sizeof(credentials);
+        if (::getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &size) < 0)
+        {
+            Log::warn() << "Failed to get the credentials of the handover peer: "
+                        << std::strerror(errno);
+            return static_cast<uid_t>(-1);
+        }
+        return credentials.uid;
+    }
+
+    struct PendingRequest
+    {
+        PendingRequest(asio::io_service& io_service) : socket(io_service)
+        {
+        }
+
+        asio::local::stream_protocol::socket socket;
+        std::uint32_t size;
+        std::string text;
+    };
+
+    void read_body(std::shared_ptr<PendingRequest> request, HandoverListener::Handler handler)
+    {
+        request->text.resize(request->size);
+
+        asio::async_read(
+            request->socket, asio::buffer(request->text), [request, handler](auto ec, auto) {
+                if (ec)
+                {
+                    Log::warn() << "Failed to read handover request: " << ec.message();
+                    return;
+                }
+
+                nlohmann::json data;
+                try
+                {
+                    data = nlohmann::json::parse(request->text);
+                }
+                catch (std::exception& e)
+                {
+                    Log::warn() << "Ignoring broken handover request: " << e.what();
+                    return;
+                }
+
+                handler(std::make_shared<HandoverRequest>(std::move(request->socket),
+                                                          data["config"]));
+            });
+    }
+
+    void read_request(std::shared_ptr<PendingRequest> request, HandoverListener::Handler handler)
+    {
+        asio::async_read(
+            request->socket,
+            asio::buffer(&request->size, sizeof(request->size)),
+            [request, handler](auto ec, auto) {
+                if (ec)
+                {
+                    Log::warn() << "Failed to read handover request: " << ec.message();
+                    return;
+                }
+                if (request->size > max_message_size)
+                {
+                    Log::warn() << "Ignoring handover request of " << request->size << " bytes";
+                    return;
+                }
+
+                read_body(request, handler);
+            });
+    }
+} // namespace
+
+HandoverRequest::HandoverRequest(asio::local::stream_protocol::socket socket, nlohmann::json config)
+: socket_(std::move(socket)), config_(std::move(config))
+{
+}
+
+void HandoverRequest::decline(const std::string& reason)
+{
+    Log::info() << "Declining handover: " << reason;
+
+    answer_ = message({ { "error", reason } });
+    asio::async_write(socket_, asio::buffer(answer_), [self = shared_from_this()](auto ec, auto) {
+        if (ec)
+        {
+            Log::warn() << "Failed to decline handover: " << ec.message();
+        }
+    });
+}
+
+void HandoverRequest::accept(device::Handover handover, const nlohmann::json& metrics)
+{
+    auto fd = handover.connection.fd;
+
+    try
+    {
+        nlohmann::json state;
+        state["device"] = std::move(handover.state);
+        state["metrics"] = metrics;
+
+        const auto& buffered = handover.connection.buffered;
+        auto data = message(state) + with_size(buffered.data(), buffered.size());
+
+        send(socket_.native_handle(), data, fd, Clock::now() + send_timeout);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+}
+
+HandoverListener::HandoverListener(
+    asio::io_service& io_service,
+    const std::string& path,
+    Handler handler)
+: io_service_(io_service), acceptor_(io_service), handler_(std::move(handler))
+{
+    ::unlink(path.c_str());
+
+    asio::local::stream_protocol::endpoint endpoint(path);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    // Whoever connects gets the device, so nobody else may connect before listen()
+    if (::chmod(path.c_str(), 0600) < 0)
+    {
+        raise("Failed to restrict access to the handover socket: ", std::strerror(errno));
+    }
+    acceptor_.listen();
+
+    Log::info() << "Listening for handover requests at " << path;
+
+    accept();
+}
+
+void HandoverListener::accept()
+{
+    auto request = std::make_shared<PendingRequest>(io_service_);
+
+    acceptor_.async_accept(request->socket, [this, request](auto ec) {
+        // the listener might be gone already
+        if (ec == asio::error::operation_aborted)
+        {
+            return;
+        }
+
+        if (ec)
+        {
+            Log::warn() << "Failed to accept handover request: " << ec.message();
+        }
+        else if (auto uid = peer_uid(request->socket.native_handle()); uid != ::geteuid())
+        {
+            Log::warn() << "Ignoring handover request of another user: " << uid;
+        }
+        else
+        {
+            // Doesn't need the listener anymore, which may go away in the meantime
+            read_request(request, handler_);
+        }
+
+        this->accept();
+    });
+}
+
+std::optional<TakenOver> take_over(const std::string& path, const nlohmann::json& config,
+                                   std::chrono::milliseconds timeout)
+{
+    auto deadline = Clock::now() + timeout;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        raise("Path of the handover socket is too long: ", path);
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket < 0)
+    {
+        raise("Failed to create handover socket: ", std::strerror(errno));
+    }
+
+    if (::connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        auto error = errno;
+        ::close(socket);
+
+        // Nobody there, which is the usual case
+        if (error == ENOENT || error == ECONNREFUSED)
+        {
+            Log::debug() << "No process to take over the recording from at " << path;
+            return std::nullopt;
+        }
+        raise("Failed to connect to the handover socket ", path, ": ", std::strerror(error));
+    }
+
+    Log::info() << "Asking the process at " << path << " to hand over its recording";
+
+    int fd = -1;
+    try
+    {
+        send(socket, message({ { "config", config } }), -1, deadline);
+
+        auto answer = receive_message(socket, fd, deadline);
+        if (answer.count("error"))
+        {
+            Log::info() << "The other process declined the handover: "
+                        << answer["error"].get<std::string>();
+            ::close(socket);
+            return std::nullopt;
+        }
+
+        std::vector<std::byte> buffered(receive_size(socket, fd, deadline));
+        receive(socket, buffered.data(), buffered.size(), fd, deadline);
+
+        if (fd < 0)
+        {
+            raise("The connection to the device is missing in the handover");
+        }
+
+        ::close(socket);
+
+        TakenOver result;
+        result.device.connection.fd = fd;
+        result.device.connection.buffered = std::move(buffered);
+        result.device.state = answer.at("device");
+        result.metrics = answer.at("metrics");
+        return result;
+    }
+    catch (...)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        ::close(socket);
+        throw;
+    }
+}
+} // namespace lmgd::source
@@ -0,0 +1,49 @@
+#include <lmgd/source/queue_policy.hpp>
+
+#include <lmgd/except.hpp>
+
+#include <string>
+
+namespace lmgd::source
+{
+QueueSettings queue_settings(const nlohmann::json& config)
+{
+    QueueSettings settings;
+
+    auto it = config.find("frame_queue");
+    if (it == config.end())
+    {
+        return settings;
+    }
+
+    auto policy = it->value("policy", "drop_newest");
+    if (policy == "drop_newest")
+    {
+        settings.policy = QueuePolicy::drop_newest;
+    }
+    else if (policy == "drop_oldest")
+    {
+        settings.policy = QueuePolicy::drop_oldest;
+    }
+    else if (policy == "block")
+    {
+        settings.policy = QueuePolicy::block;
+    }
+    else if (policy == "decimate")
+    {
+        settings.policy = QueuePolicy::decimate;
+    }
+    else
+    {
+        raise("Unknown frame queue policy: ", policy);
+    }
+
+    settings.decimation = it->value("decimation", settings.decimation);
+    if (settings.decimation < 2)
+    {
+        raise("The decimation of the frame queue must be at least 2");
+    }
+
+    return settings;
+}
+} // namespace lmgd::source
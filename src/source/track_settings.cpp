@@ -0,0 +1,77 @@
+#include <lmgd/source/track_settings.hpp>
+
+#include <lmgd/device/channel.hpp>
+#include <lmgd/except.hpp>
+
+#include <set>
+#include <utility>
+
+namespace lmgd::source
+{
+void check_track_settings(
+    const nlohmann::json& config,
+    const std::string& key,
+    device::MeasurementMode mode)
+{
+    for (const auto& channel : config.at("channels"))
+    {
+        auto it = channel.find(key);
+        if (it == channel.end())
+        {
+            continue;
+        }
+
+        auto name = channel.at("name").get<std::string>();
+        std::set<std::pair<device::MetricType, device::MetricBandwidth>> metrics;
+        for (const auto& metric : channel.at("metrics"))
+        {
+            metrics.insert(device::Channel::parse_metric(metric.get<std::string>(), mode, name));
+        }
+
+        for (auto entry = it->begin(); entry != it->end(); ++entry)
+        {
+            if (entry.key() != "default" &&
+                !metrics.count(device::Channel::parse_metric(entry.key(), mode, name)))
+            {
+                raise(
+                    "The ",
+                    key,
+                    " of ",
+                    entry.key(),
+                    " is given, but channel ",
+                    name,
+                    " doesn't record it");
+            }
+        }
+    }
+}
+
+nlohmann::json track_setting(
+    const nlohmann::json& config,
+    const std::string& key,
+    const device::Track& track,
+    device::MeasurementMode mode,
+    const nlohmann::json& fallback)
+{
+    const auto& channel = config.at("channels").at(track.channel().id() - 1);
+
+    auto it = channel.find(key);
+    if (it == channel.end())
+    {
+        return fallback;
+    }
+
+    auto name = channel.at("name").get<std::string>();
+    for (auto entry = it->begin(); entry != it->end(); ++entry)
+    {
+        if (entry.key() != "default" &&
+            device::Channel::parse_metric(entry.key(), mode, name) ==
+                std::make_pair(track.type(), track.bandwidth()))
+        {
+            return entry.value();
+        }
+    }
+
+    return it->value("default", fallback);
+}
+} // namespace lmgd::source
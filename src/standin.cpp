@@ -0,0 +1,489 @@
+// A minimal stand-in for an LMG device on a local TCP port or a pseudo-terminal. It answers the
+// queries issued by lmgd with plausible values and streams synthetic gapless or cycle frames after
+// ":INIT:CONT ON".
+//
+// This is meant for benchmarks and local tests of lmgd, not as an emulation of the device.
+
+#include <nitro/options/parser.hpp>
+
+#include <asio/buffer.hpp>
+#include <asio/buffers_iterator.hpp>
+#include <asio/io_service.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/posix/stream_descriptor.hpp>
+#include <asio/read_until.hpp>
+#include <asio/streambuf.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+}
+
+using asio::ip::tcp;
+
+namespace
+{
+struct Settings
+{
+    std::string serial;
+    int64_t gap_length;
+    double sampling_rate;
+    // ignore the sampling rate and send frames as fast as possible
+    bool flood;
+};
+
+// The values set by commands, which outlive a session like the setup of a real device. Keyed by
+// the command header and for commands with several arguments by the first argument as well.
+using Values = std::map<std::string, std::string>;
+
+// Stream is either a TCP socket or the master side of a pseudo-terminal
+template <typename Stream>
+class Session
+{
+public:
+    Session(Stream socket, const Settings& settings, Values& values)
+    : socket_(std::move(socket)), settings_(settings), values_(values)
+    {
+    }
+
+    ~Session()
+    {
+        stop_streaming();
+    }
+
+    void run()
+    {
+        asio::streambuf buffer;
+        asio::error_code ec;
+
+        while (true)
+        {
+            auto bytes = asio::read_until(socket_, buffer, '\n', ec);
+            if (ec)
+            {
+                return;
+            }
+
+            std::string line(
+                asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + bytes - 1);
+            buffer.consume(bytes);
+
+            // lmgd sends a terminating null byte after each command
+            line.erase(std::remove(line.begin(), line.end(), '\0'), line.end());
+
+            handle_line(line);
+        }
+    }
+
+private:
+    void handle_line(const std::string& line)
+    {
+        if (line.rfind("ACTN", 0) == 0 || line.rfind(":TRIG:ACT", 0) == 0)
+        {
+            // The trigger action, which defines the content of each frame. Nothing to answer.
+            tracks_ = count(line, "GLPVAL?") + count(line, ":FETC");
+            return;
+        }
+
+        std::vector<std::string> answers;
+        std::stringstream commands(line);
+        std::string command;
+
+        while (std::getline(commands, command, ';'))
+        {
+            while (!command.empty() && command.front() == ' ')
+            {
+                command.erase(0, 1);
+            }
+
+            if (command.empty())
+            {
+                continue;
+            }
+
+            auto header = command.substr(0, command.find(' '));
+            if (header.back() == '?')
+            {
+                answers.push_back(answer(command));
+            }
+            else
+            {
+                execute(command);
+            }
+        }
+
+        if (answers.empty())
+        {
+            return;
+        }
+
+        std::string response;
+        for (const auto& answer : answers)
+        {
+            response += (response.empty() ? "" : ";") + answer;
+        }
+
+        if (binary_)
+        {
+            write(chunk(response.data(), response.size()) + "\n");
+        }
+        else
+        {
+            write(response + "\n");
+        }
+    }
+
+    std::string answer(const std::string& query)
+    {
+        if (query == "*idn?")
+        {
+            return "ZES ZIMMER Electronic Systems GmbH,LMG-STANDIN," + settings_.serial + ",1.0";
+        }
+        if (query == ":SYST:ERR:ALL?" || query == "ERRALL?")
+        {
+            return "0,\"No error\"";
+        }
+        if (query == ":FETC:SCOP:GAPL:TLEN?")
+        {
+            return std::to_string(settings_.gap_length);
+        }
+        if (query == ":FETC:SCOP:GAPL:SRATE?")
+        {
+            return std::to_string(settings_.sampling_rate);
+        }
+        if (query == ":SENS:SWE:TIME?")
+        {
+            return "0.05";
+        }
+        if (query == "*opc?")
+        {
+            return "1";
+        }
+
+        // Values set before, e.g., ":SENS:CURR:RANG1?" or ":SENS:GAPL:TRAC? 0"
+        auto key = query;
+        key.erase(key.find('?'), 1);
+        auto it = values_.find(key);
+        if (it != values_.end())
+        {
+            return it->second;
+        }
+
+        return "0";
+    }
+
+    void execute(const std::string& command)
+    {
+        if (command == ":FORM:DATA 1")
+        {
+            binary_ = true;
+        }
+        else if (command == ":FORM:DATA 0" || command == "*rst")
+        {
+            stop_streaming();
+            binary_ = false;
+
+            if (command == "*rst")
+            {
+                values_.clear();
+            }
+        }
+        else if (command == ":INIT:CONT ON")
+        {
+            start_streaming();
+        }
+        else if (command == ":INIT:CONT OFF")
+        {
+            stop_streaming();
+        }
+        else if (command.rfind(":SYST:COMM:SER:BAUD", 0) == 0)
+        {
+            // A pseudo-terminal doesn't care about the baud rate
+            std::cerr << "Baud rate change: " << command << '\n';
+        }
+        else if (auto space = command.find(' '); space != std::string::npos)
+        {
+            auto arguments = command.substr(space + 1);
+            auto comma = arguments.find(',');
+            if (comma == std::string::npos)
+            {
+                values_[command.substr(0, space)] = arguments;
+            }
+            else
+            {
+                values_[command.substr(0, space) + " " + arguments.substr(0, comma)] =
+                    arguments.substr(comma + 1);
+            }
+        }
+    }
+
+    void start_streaming()
+    {
+        stop_streaming();
+
+        std::cerr << "Start streaming " << tracks_ << " tracks\n";
+
+        streaming_ = true;
+        stream_thread_ = std::thread([this]() { stream(); });
+    }
+
+    void stop_streaming()
+    {
+        streaming_ = false;
+        if (stream_thread_.joinable())
+        {
+            stream_thread_.join();
+            std::cerr << "Stopped streaming\n";
+        }
+    }
+
+    void stream()
+    {
+        auto gapless = settings_.gap_length > 0;
+        auto samples = gapless ? settings_.gap_length : 1;
+        auto frame_duration = std::chrono::nanoseconds(
+            static_cast<int64_t>(1e9 * samples / settings_.sampling_rate));
+
+        std::vector<float> values(samples);
+        auto next = std::chrono::steady_clock::now();
+        int64_t timestamp =
+            std::chrono::system_clock::now().time_since_epoch() / std::chrono::nanoseconds(1);
+        uint64_t frame = 0;
+
+        while (streaming_)
+        {
+            for (std::size_t i = 0; i < values.size(); i++)
+            {
+                values[i] = 10.f + std::sin((frame * samples + i) * 0.001f);
+            }
+
+            std::string data;
+            if (gapless)
+            {
+                int64_t duration = frame_duration.count();
+                data += chunk(&timestamp, sizeof(timestamp));
+                data += chunk(&duration, sizeof(duration));
+                for (int track = 0; track < tracks_; track++)
+                {
+                    std::string list(sizeof(int64_t) + values.size() * sizeof(float), '\0');
+                    std::memcpy(list.data(), &samples, sizeof(int64_t));
+                    std::memcpy(list.data() + sizeof(int64_t),
+                                values.data(),
+                                values.size() * sizeof(float));
+                    data += chunk(list.data(), list.size());
+                }
+            }
+            else
+            {
+                for (int track = 0; track < tracks_; track++)
+                {
+                    data += chunk(values.data(), sizeof(float));
+                }
+            }
+
+            if (binary_)
+            {
+                write(data + "\n");
+            }
+            else
+            {
+                std::string line;
+                for (int track = 0; track < tracks_; track++)
+                {
+                    line += (track ? ";" : "") + std::to_string(values[0]);
+                }
+                write(line + "\n");
+            }
+
+            timestamp += frame_duration.count();
+            ++frame;
+
+            if (!settings_.flood)
+            {
+                next += frame_duration;
+                std::this_thread::sleep_until(next);
+            }
+        }
+    }
+
+    static std::string chunk(const void* data, std::size_t size)
+    {
+        auto size_str = std::to_string(size);
+        return "#" + std::to_string(size_str.size()) + size_str +
+               std::string(static_cast<const char*>(data), size);
+    }
+
+    static int count(const std::string& str, const std::string& pattern)
+    {
+        int result = 0;
+        for (auto pos = str.find(pattern); pos != std::string::npos;
+             pos = str.find(pattern, pos + 1))
+        {
+            ++result;
+        }
+        return result;
+    }
+
+    void write(const std::string& data)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        asio::error_code ec;
+        asio::write(socket_, asio::buffer(data), ec);
+        if (ec)
+        {
+            streaming_ = false;
+        }
+    }
+
+private:
+    Stream socket_;
+    const Settings& settings_;
+    Values& values_;
+    std::mutex write_mutex_;
+    std::atomic<bool> binary_ = false;
+    std::atomic<bool> streaming_ = false;
+    std::atomic<int> tracks_ = 1;
+    std::thread stream_thread_;
+};
+
+// The device answers "break" on the port next to the data port with "0"
+void serve_reset(asio::io_service& io_service, int port)
+{
+    tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
+
+    while (true)
+    {
+        tcp::socket socket(io_service);
+        acceptor.accept(socket);
+
+        asio::streambuf buffer;
+        asio::error_code ec;
+        asio::read_until(socket, buffer, '\n', ec);
+        asio::write(socket, asio::buffer(std::string("0\n")), ec);
+    }
+}
+// Serves sessions on a pseudo-terminal, lmgd connects to the printed slave device with a serial
+// connection.
+void serve_pty(asio::io_service& io_service, const Settings& settings)
+{
+    auto master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    {
+        throw std::runtime_error("Failed to create a pseudo-terminal");
+    }
+
+    termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    std::cerr << "Serving on pseudo-terminal " << ptsname(master) << '\n';
+
+    Values values;
+
+    while (true)
+    {
+        // Reading from the master fails, while the slave side isn't opened
+        Session<asio::posix::stream_descriptor> session(
+            asio::posix::stream_descriptor(io_service, ::dup(master)), settings, values);
+        session.run();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    nitro::options::parser parser("lmg-standin");
+
+    parser.option("port", "The TCP port for the data connection. The reset port is port + 1.")
+        .default_value("5025")
+        .short_name("p");
+    parser.option("serial", "The serial number reported by *idn?").default_value("00000000");
+    parser.option("gap-length", "Values per track and frame. Use 0 for cycle mode.")
+        .default_value("1000");
+    parser.option("sampling-rate", "Samples per second").default_value("50000");
+    parser.toggle("flood", "Send frames as fast as possible").short_name("f");
+    parser.toggle("pty", "Serve on a pseudo-terminal instead of TCP");
+    parser.toggle("help").short_name("h");
+
+    try
+    {
+        auto options = parser.parse(argc, argv);
+
+        if (options.given("help"))
+        {
+            parser.usage();
+            return 0;
+        }
+
+        Settings settings{ options.get("serial"),
+                           std::stoll(options.get("gap-length")),
+                           std::stod(options.get("sampling-rate")),
+                           options.given("flood") };
+        auto port = std::stoi(options.get("port"));
+
+        asio::io_service io_service;
+
+        if (options.given("pty"))
+        {
+            serve_pty(io_service, settings);
+            return 0;
+        }
+
+        std::thread reset_thread([&]() { serve_reset(io_service, port + 1); });
+        reset_thread.detach();
+
+        tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
+        std::cerr << "Listening on port " << port << '\n';
+
+        Values values;
+
+        while (true)
+        {
+            tcp::socket socket(io_service);
+            acceptor.accept(socket);
+            std::cerr << "Accepted connection\n";
+
+            Session<tcp::socket> session(std::move(socket), settings, values);
+            session.run();
+
+            std::cerr << "Connection closed\n";
+        }
+    }
+    catch (nitro::options::parsing_error& e)
+    {
+        std::cerr << e.what() << '\n';
+
+        parser.usage();
+
+        return 1;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+
+    return 0;
+}